@@ -1,5 +1,6 @@
 #include "devices/pit.h"
 #include <debug.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include "threads/interrupt.h"
 #include "threads/io.h"
@@ -11,9 +12,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -81,3 +79,49 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Starts channel CHANNEL counting down COUNT cycles in mode 0,
+   "interrupt on terminal count": its output goes high, and stays
+   high, once the count runs out.  On channel 0 this yields a
+   single timer interrupt COUNT / PIT_HZ seconds from now.  A
+   COUNT of 0 is treated as 65536.  Use pit_configure_channel()
+   to go back to a periodic interrupt. */
+void
+pit_start_oneshot (int channel, uint16_t count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, (channel << 6) | 0x30);
+  outb (PIT_PORT_COUNTER (channel), count);
+  outb (PIT_PORT_COUNTER (channel), count >> 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the current count of channel CHANNEL and stores the
+   state of its output in *OUT, using the 8254 read-back command
+   so that both are latched at the same instant.  Right after a
+   count is loaded, the count register has not been updated yet;
+   in that case the count originally loaded is reported as
+   LOADED. */
+uint16_t
+pit_read_channel (int channel, uint16_t loaded, bool *out)
+{
+  enum intr_level old_level;
+  uint8_t status;
+  uint16_t count;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0xc0 | (2 << channel));
+  status = inb (PIT_PORT_COUNTER (channel));
+  count = inb (PIT_PORT_COUNTER (channel));
+  count |= inb (PIT_PORT_COUNTER (channel)) << 8;
+  intr_set_level (old_level);
+
+  *out = (status & 0x80) != 0;
+  return status & 0x40 ? loaded : count;
+}
@@ -7,8 +7,6 @@
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
-  
-static struct list sleep_list;
 
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -26,18 +24,95 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Pending timer events are kept in a hierarchical timer wheel.
+   Level L has WHEEL_SLOTS slots, each covering 64**L ticks, so
+   level 0 holds the events due in the next 64 ticks one slot per
+   tick, level 1 the events due in the next 4096 ticks, and so
+   on.  Each tick runs the events in one level-0 slot.  Every 64
+   ticks, the next level-1 slot is "cascaded": its events are
+   spread over level 0, and likewise for higher levels every
+   64**L ticks.  Thus each tick costs O(1) plus the events that
+   actually fire, however many events are pending.  Events due
+   beyond the top level wait on wheel_overflow until it comes in
+   range. */
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+static struct list wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static struct list wheel_overflow;
+
+/* Next tick whose level-0 slot has not been run yet. */
+static int64_t wheel_next;
+
+/* Tickless operation.
+
+   If true, tickless operation was requested by the kernel
+   command-line option -tickless.  It takes effect once the
+   timer has been calibrated.
+
+   When the scheduler switches to the idle thread with no thread
+   waiting on the ready queues, it calls timer_tickless_enter().
+   That switches the PIT from a periodic interrupt to a single
+   interrupt at the next tick at which a timer event is due, as
+   far ahead as the PIT's 16-bit counter allows.  The timer
+   interrupt then processes all of the ticks skipped since, one
+   after another, charging each skipped tick to the idle thread
+   that was running during it, so that timer events, scheduler
+   statistics and MLFQS bookkeeping come out exactly as if every
+   tick had interrupted.  The interrupt returns the PIT to
+   periodic mode.
+
+   In between, timer_ticks() adds the ticks that have gone by
+   according to the PIT's count.  If another thread becomes
+   ready or an earlier event is scheduled, timer_tickless_exit()
+   cuts the one-shot count short at the next tick boundary. */
+bool timer_tickless;
+static bool tickless_enabled;
+
+/* PIT cycles per timer tick. */
+#define TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* State of a one-shot count in progress.  The timer interrupt
+   will process ONESHOT_TICKS ticks: ONESHOT_BASE ticks that had
+   already gone by when the PIT was loaded with ONESHOT_COUNT,
+   plus one for each tick boundary during the count.  The first
+   boundary falls ONESHOT_PHASE cycles after the load, and the
+   rest TICK_CYCLES apart.  ONESHOT_TICKS is 0 in periodic
+   mode. */
+static int64_t oneshot_ticks;
+static int64_t oneshot_base;
+static uint16_t oneshot_count;
+static uint16_t oneshot_phase;
+
+/* Statistics. */
+static long long oneshot_cnt;   /* One-shot counts started. */
+static long long skipped_cnt;   /* Ticks processed without an interrupt. */
+
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static void wheel_insert (struct timer_event *);
+static void wheel_advance (void);
+static int64_t wheel_quiet_ticks (int64_t max);
+static int64_t oneshot_elapsed (bool *expired);
+static uint16_t oneshot_boundaries (uint16_t cycles);
+static void wake_sleeper (void *thread);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
-  list_init(&sleep_list);
+  int level, slot;
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (slot = 0; slot < WHEEL_SLOTS; slot++)
+      list_init (&wheel[level][slot]);
+  list_init (&wheel_overflow);
+  wheel_next = 1;
+
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
@@ -67,6 +142,10 @@ timer_calibrate (void)
       loops_per_tick |= test_bit;
 
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+  /* Skipping ticks would throw off the calibration loop above,
+     so tickless operation starts only now. */
+  tickless_enabled = timer_tickless;
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -75,6 +154,11 @@ timer_ticks (void)
 {
   enum intr_level old_level = intr_disable ();
   int64_t t = ticks;
+  if (oneshot_ticks > 0)
+    {
+      bool expired;
+      t += oneshot_elapsed (&expired);
+    }
   intr_set_level (old_level);
   return t;
 }
@@ -93,22 +177,27 @@ void
 timer_sleep (int64_t ticks) 
 {
   int64_t start = timer_ticks ();
+  struct timer_event wakeup;
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  
-  struct thread *cur = thread_current();
-  enum intr_level old_level;
+  ASSERT (!intr_context ());
 
-  ASSERT (!intr_context());
+  if (ticks <= 0)
+    return;
 
-  old_level = intr_disable();  
-  if (ticks > 0) {
-    cur->wake_up_time = start + ticks;
-    list_push_back(&sleep_list, &cur->elem);
-    thread_block();
-  }
-  
-  intr_set_level(old_level);
+  timer_event_init (&wakeup, wake_sleeper, thread_current ());
+  old_level = intr_disable ();
+  timer_event_schedule (&wakeup, start + ticks);
+  thread_block ();
+  intr_set_level (old_level);
+}
+
+/* Timer event function for timer_sleep(). */
+static void
+wake_sleeper (void *thread)
+{
+  thread_unblock (thread);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -179,30 +268,296 @@ void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  if (tickless_enabled)
+    printf ("Timer: %lld one-shot counts, %lld ticks skipped\n",
+            oneshot_cnt, skipped_cnt);
+}
+
+/* Switches the PIT to a single interrupt at the next tick at
+   which anything is due, if tickless operation is enabled and
+   that is at least two ticks away.  Called by the scheduler,
+   with interrupts off, when it switches to the idle thread with
+   no thread ready to run. */
+void
+timer_tickless_enter (void)
+{
+  uint16_t phase;
+  int64_t max, cnt;
+  bool out;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!tickless_enabled || oneshot_ticks > 0)
+    return;
+
+  /* Count the ticks that fit in one 16-bit count from here: the
+     rest of the current tick, then whole ticks. */
+  phase = pit_read_channel (0, TICK_CYCLES, &out);
+  if (phase == 0 || phase > TICK_CYCLES)
+    return;
+  max = 1 + (UINT16_MAX - phase) / TICK_CYCLES;
+  cnt = wheel_quiet_ticks (max);
+  if (cnt < 2)
+    return;
+
+  oneshot_count = phase + (cnt - 1) * TICK_CYCLES;
+  oneshot_phase = phase;
+  oneshot_base = 0;
+  oneshot_ticks = cnt;
+  pit_start_oneshot (0, oneshot_count);
+  oneshot_cnt++;
+}
+
+/* Cuts a one-shot count in progress short, so that the timer
+   interrupts again at the next tick boundary and resumes
+   periodic operation.  Called with interrupts off when a thread
+   becomes ready or an event is scheduled. */
+void
+timer_tickless_exit (void)
+{
+  uint16_t cycles, passed;
+  bool expired;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_ticks == 0)
+    return;
+  cycles = oneshot_count - pit_read_channel (0, oneshot_count, &expired);
+  passed = oneshot_boundaries (cycles);
+  if (expired || oneshot_base + passed + 1 >= oneshot_ticks)
+    return;
+
+  /* Load the count up to the next boundary, keeping the ticks
+     that have already gone by in ONESHOT_BASE. */
+  oneshot_count = oneshot_phase + passed * TICK_CYCLES - cycles;
+  oneshot_phase = oneshot_count;
+  oneshot_base += passed;
+  oneshot_ticks = oneshot_base + 1;
+  pit_start_oneshot (0, oneshot_count);
+}
+
+/* Returns the number of ticks that have gone by during the
+   current one-shot count, and sets *EXPIRED to whether the count
+   has run out. */
+static int64_t
+oneshot_elapsed (bool *expired)
+{
+  uint16_t count = pit_read_channel (0, oneshot_count, expired);
+
+  if (*expired)
+    return oneshot_ticks;
+  return oneshot_base + oneshot_boundaries (oneshot_count - count);
+}
+
+/* Returns the number of tick boundaries within the first CYCLES
+   cycles of the current one-shot count. */
+static uint16_t
+oneshot_boundaries (uint16_t cycles)
+{
+  if (cycles < oneshot_phase)
+    return 0;
+  return 1 + (cycles - oneshot_phase) / TICK_CYCLES;
 }
 
-/* Timer interrupt handler. */
+/* Initializes timer event EVENT to call FUNC(AUX) when it
+   fires. */
+void
+timer_event_init (struct timer_event *event, timer_event_func *func,
+                  void *aux)
+{
+  ASSERT (event != NULL);
+  ASSERT (func != NULL);
+
+  event->func = func;
+  event->aux = aux;
+  event->pending = false;
+}
+
+/* Schedules EVENT to fire at the first timer tick at or after
+   EXPIRES, an absolute tick count as returned by timer_ticks().
+   If EVENT was already scheduled, it is moved.  May be called
+   from an interrupt handler, including from an event's own
+   function. */
+void
+timer_event_schedule (struct timer_event *event, int64_t expires)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (event->pending)
+    list_remove (&event->elem);
+  event->expires = expires;
+  event->pending = true;
+  wheel_insert (event);
+  if (expires < ticks + oneshot_ticks)
+    timer_tickless_exit ();
+  intr_set_level (old_level);
+}
+
+/* Cancels EVENT if it has not fired yet.  Returns true if it was
+   pending, false if it had already fired or was never
+   scheduled. */
+bool
+timer_event_cancel (struct timer_event *event)
+{
+  enum intr_level old_level = intr_disable ();
+  bool was_pending = event->pending;
+
+  if (was_pending)
+    {
+      list_remove (&event->elem);
+      event->pending = false;
+    }
+  intr_set_level (old_level);
+  return was_pending;
+}
+
+/* Puts pending EVENT in the wheel slot for its expiry time.  An
+   event that is already due goes in the slot for wheel_next. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+wheel_insert (struct timer_event *event)
 {
-  ticks++;
-
-  if (!list_empty(&sleep_list)) {
-    struct list_elem *e = list_begin(&sleep_list);
-
-    while (e != list_end(&sleep_list)) {
-      struct thread *t = list_entry(e, struct thread, elem);
-      struct list_elem *next = list_next(e);
-      
-      if (ticks >= t->wake_up_time) {
-        list_remove(e);
-        thread_unblock(t);
+  int64_t expires = event->expires > wheel_next ? event->expires : wheel_next;
+  int64_t delta = expires - wheel_next;
+  int level;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    if (delta < (int64_t) 1 << (WHEEL_BITS * (level + 1)))
+      {
+        int slot = (expires >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+        list_push_back (&wheel[level][slot], &event->elem);
+        return;
       }
-      e = next;
+  list_push_back (&wheel_overflow, &event->elem);
+}
+
+/* Moves all the events in LIST back into the wheel, relative to
+   the current wheel_next. */
+static void
+wheel_reinsert (struct list *list)
+{
+  while (!list_empty (list))
+    wheel_insert (list_entry (list_pop_front (list),
+                              struct timer_event, elem));
+}
+
+/* Returns the number of ticks from now, up to MAX, until the
+   first tick at which a pending event fires or a higher level of
+   the wheel that holds events is cascaded. */
+static int64_t
+wheel_quiet_ticks (int64_t max)
+{
+  int64_t cnt;
+
+  ASSERT (wheel_next == ticks + 1);
+
+  for (cnt = 1; cnt < max; cnt++)
+    {
+      int64_t t = ticks + cnt;
+      int level;
+
+      if (!list_empty (&wheel[0][t & (WHEEL_SLOTS - 1)]))
+        break;
+      for (level = 1; level < WHEEL_LEVELS; level++)
+        if ((t & (((int64_t) 1 << (WHEEL_BITS * level)) - 1)) == 0
+            && !list_empty (&wheel[level][(t >> (WHEEL_BITS * level))
+                                          & (WHEEL_SLOTS - 1)]))
+          return cnt;
+      if ((t & (((int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1)) == 0
+          && !list_empty (&wheel_overflow))
+        break;
+    }
+  return cnt;
+}
+
+/* Runs the level-0 slot for wheel_next, after cascading the
+   higher-level slots that come due at that tick. */
+static void
+wheel_advance (void)
+{
+  int64_t now = wheel_next;
+  struct list due;
+  int level;
+
+  /* Cascade, highest level first, so that events can fall more
+     than one level in a single tick. */
+  if ((now & (((int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1)) == 0)
+    {
+      list_init (&due);
+      list_splice (list_end (&due), list_begin (&wheel_overflow),
+                   list_end (&wheel_overflow));
+      wheel_reinsert (&due);
     }
+  for (level = WHEEL_LEVELS - 1; level > 0; level--)
+    if ((now & (((int64_t) 1 << (WHEEL_BITS * level)) - 1)) == 0)
+      {
+        struct list *slot = &wheel[level][(now >> (WHEEL_BITS * level))
+                                          & (WHEEL_SLOTS - 1)];
+        list_init (&due);
+        list_splice (list_end (&due), list_begin (slot), list_end (slot));
+        wheel_reinsert (&due);
+      }
+
+  /* Take the due events off the wheel before running any, so
+     that an event that reschedules itself for NOW or earlier
+     lands in the next tick's slot instead of this one. */
+  list_init (&due);
+  {
+    struct list *slot = &wheel[0][now & (WHEEL_SLOTS - 1)];
+    list_splice (list_end (&due), list_begin (slot), list_end (slot));
   }
-  
-  thread_tick ();
+  wheel_next = now + 1;
+
+  while (!list_empty (&due))
+    {
+      struct timer_event *event = list_entry (list_pop_front (&due),
+                                              struct timer_event, elem);
+      ASSERT (event->expires <= now);
+      event->pending = false;
+      event->func (event->aux);
+    }
+}
+
+/* Timer interrupt handler. */
+static void
+timer_interrupt (struct intr_frame *args UNUSED)
+{
+  int64_t cnt = 1;
+
+  if (oneshot_ticks > 0)
+    {
+      bool expired;
+
+      oneshot_elapsed (&expired);
+      if (expired)
+        {
+          cnt = oneshot_ticks;
+          skipped_cnt += cnt - 1;
+          oneshot_ticks = 0;
+          pit_configure_channel (0, 2, TIMER_FREQ);
+        }
+      else
+        {
+          /* This interrupt is from the periodic tick that was
+             already pending when the count was started, so the
+             count ends a tick later than intended.  Count this
+             tick like any other and end the count at the next
+             boundary. */
+          timer_tickless_exit ();
+        }
+    }
+
+  while (cnt-- > 0)
+    {
+      ticks++;
+      while (wheel_next <= ticks)
+        wheel_advance ();
+      if (cnt > 0)
+        thread_tick_idle ();
+      else
+        thread_tick ();
+    }
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -1,7 +1,9 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -26,4 +28,31 @@ void timer_ndelay (int64_t nanoseconds);
 
 void timer_print_stats (void);
 
+/* Tickless operation. */
+extern bool timer_tickless;
+void timer_tickless_enter (void);
+void timer_tickless_exit (void);
+
+/* Timer events.
+
+   A timer event calls FUNC(AUX) from the timer interrupt handler
+   at the first timer tick at or after EXPIRES.  FUNC therefore
+   runs with interrupts off in an external interrupt context: it
+   must not sleep, but it may unblock threads, "up" semaphores,
+   and reschedule its own event. */
+typedef void timer_event_func (void *aux);
+
+struct timer_event
+  {
+    int64_t expires;            /* Tick to fire at. */
+    timer_event_func *func;     /* Function to call. */
+    void *aux;                  /* Argument for FUNC. */
+    bool pending;               /* Scheduled and not yet fired? */
+    struct list_elem elem;      /* Element in a timer wheel slot. */
+  };
+
+void timer_event_init (struct timer_event *, timer_event_func *, void *aux);
+void timer_event_schedule (struct timer_event *, int64_t expires);
+bool timer_event_cancel (struct timer_event *);
+
 #endif /* devices/timer.h */
@@ -0,0 +1,326 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Buffer cache.
+
+   Holds up to CACHE_SIZE sectors of the file system device so
+   that inode.c never has to go to the disk directly.  A write
+   only updates the cached copy and marks it dirty; the sector
+   reaches the disk when it is evicted, when the write-behind
+   thread makes its periodic pass, or when filesys_done() calls
+   cache_flush().  Repeated partial writes to one sector are
+   therefore coalesced into a single disk write.
+
+   Victims are chosen with the clock algorithm.  An entry with a
+   nonzero pin count is in use by some thread and is never
+   evicted.  A dirty victim is written back with cache_lock
+   released, so other lookups do not wait for the disk.
+
+   BUFFER is never user memory: a page fault while an entry is
+   locked could read a file through the cache and want the same
+   entry.  inode.c copies user buffers through kernel memory
+   before they get here. */
+
+/* Ticks between two passes of the write-behind thread. */
+#define CACHE_FLUSH_INTERVAL TIMER_FREQ
+
+/* A cached sector. */
+struct cache_entry
+  {
+    block_sector_t sector;      /* Sector held, if VALID. */
+    bool valid;                 /* Assigned to SECTOR? */
+    bool accessed;              /* Used since the clock hand passed? */
+    int pin_cnt;                /* Number of threads using the entry. */
+
+    struct lock lock;           /* Protects the members below. */
+    bool loaded;                /* DATA matches or supersedes disk? */
+    bool dirty;                 /* DATA must be written back? */
+    uint8_t *data;              /* BLOCK_SECTOR_SIZE bytes of data. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+
+/* Protects sector assignment, pin counts, accessed bits and the
+   clock hand. */
+static struct lock cache_lock;
+static size_t clock_hand;
+
+/* Statistics. */
+static unsigned long long hit_cnt;      /* Lookups found in cache. */
+static unsigned long long miss_cnt;     /* Lookups that had to evict. */
+static unsigned long long write_cnt;    /* Sectors written back. */
+
+/* Write-behind scheduling.  flush_event fires every
+   CACHE_FLUSH_INTERVAL ticks and wakes the write-behind thread
+   through flush_sema. */
+static struct timer_event flush_event;
+static struct semaphore flush_sema;
+
+static struct cache_entry *cache_pin (block_sector_t, bool need_data);
+static void cache_unpin (struct cache_entry *);
+static thread_func write_behind NO_RETURN;
+static timer_event_func flush_tick;
+
+/* Initializes the buffer cache and starts the write-behind
+   thread. */
+void
+cache_init (void)
+{
+  uint8_t *pages;
+  size_t i;
+
+  pages = palloc_get_multiple (PAL_ASSERT,
+                               CACHE_SIZE * BLOCK_SECTOR_SIZE / PGSIZE);
+  lock_init (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      e->valid = false;
+      e->accessed = false;
+      e->pin_cnt = 0;
+      lock_init (&e->lock);
+      e->loaded = false;
+      e->dirty = false;
+      e->data = pages + i * BLOCK_SECTOR_SIZE;
+    }
+  clock_hand = 0;
+
+  sema_init (&flush_sema, 0);
+  timer_event_init (&flush_event, flush_tick, NULL);
+  thread_create ("write-behind", PRI_DEFAULT, write_behind, NULL);
+  timer_event_schedule (&flush_event, timer_ticks () + CACHE_FLUSH_INTERVAL);
+}
+
+/* Copies SIZE bytes starting at SECTOR_OFS within SECTOR into
+   BUFFER. */
+void
+cache_read (block_sector_t sector, void *buffer, int sector_ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (sector_ofs >= 0 && size >= 0);
+  ASSERT (sector_ofs + size <= BLOCK_SECTOR_SIZE);
+  ASSERT (!is_user_vaddr (buffer));
+
+  e = cache_pin (sector, true);
+  memcpy (buffer, e->data + sector_ofs, size);
+  cache_unpin (e);
+}
+
+/* Copies SIZE bytes from BUFFER into SECTOR starting at
+   SECTOR_OFS.  The data is written to disk later. */
+void
+cache_write (block_sector_t sector, const void *buffer, int sector_ofs,
+             int size)
+{
+  struct cache_entry *e;
+  bool whole = sector_ofs == 0 && size == BLOCK_SECTOR_SIZE;
+
+  ASSERT (sector_ofs >= 0 && size >= 0);
+  ASSERT (sector_ofs + size <= BLOCK_SECTOR_SIZE);
+  ASSERT (!is_user_vaddr (buffer));
+
+  e = cache_pin (sector, !whole);
+  memcpy (e->data + sector_ofs, buffer, size);
+  e->loaded = true;
+  e->dirty = true;
+  cache_unpin (e);
+}
+
+/* Writes every dirty sector back to disk. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      lock_acquire (&cache_lock);
+      if (!e->valid || !e->dirty)
+        {
+          lock_release (&cache_lock);
+          continue;
+        }
+      e->pin_cnt++;
+      lock_release (&cache_lock);
+
+      lock_acquire (&e->lock);
+      if (e->dirty)
+        {
+          block_write (fs_device, e->sector, e->data);
+          e->dirty = false;
+          write_cnt++;
+        }
+      cache_unpin (e);
+    }
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Cache: %llu hits, %llu misses, %llu write-backs\n",
+          hit_cnt, miss_cnt, write_cnt);
+}
+
+/* Returns the entry that holds SECTOR, or a null pointer if
+   SECTOR is not cached.  Must be called with cache_lock held. */
+static struct cache_entry *
+cache_lookup (block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Chooses an unpinned entry to reuse with the clock algorithm.
+   Returns a null pointer if every entry is pinned.  Must be
+   called with cache_lock held. */
+static struct cache_entry *
+cache_evict (void)
+{
+  size_t i;
+
+  /* Two sweeps are enough: the first clears every accessed bit
+     it passes. */
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (e->pin_cnt > 0)
+        continue;
+      if (e->valid && e->accessed)
+        {
+          e->accessed = false;
+          continue;
+        }
+      return e;
+    }
+  return NULL;
+}
+
+/* Pins the entry for SECTOR, bringing it into the cache if
+   necessary, and returns it with its lock held.  If NEED_DATA is
+   false the caller is about to overwrite the whole sector, so it
+   is not read from disk. */
+static struct cache_entry *
+cache_pin (block_sector_t sector, bool need_data)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      e = cache_lookup (sector);
+      if (e != NULL)
+        {
+          hit_cnt++;
+          break;
+        }
+
+      e = cache_evict ();
+      if (e != NULL)
+        {
+          /* Write a dirty victim back with only its own lock held,
+             then start over: SECTOR may have been brought into
+             another entry while cache_lock was released, and the
+             victim may have been pinned or dirtied again.  A victim
+             is only claimed on a pass that keeps cache_lock held
+             throughout. */
+          if (e->valid && e->dirty)
+            {
+              e->pin_cnt++;
+              lock_release (&cache_lock);
+
+              lock_acquire (&e->lock);
+              if (e->dirty)
+                {
+                  block_write (fs_device, e->sector, e->data);
+                  e->dirty = false;
+                  write_cnt++;
+                }
+              lock_release (&e->lock);
+
+              lock_acquire (&cache_lock);
+              e->pin_cnt--;
+              continue;
+            }
+          e->sector = sector;
+          e->valid = true;
+          e->loaded = false;
+          e->dirty = false;
+          miss_cnt++;
+          break;
+        }
+
+      /* Every entry is in use.  Let someone finish. */
+      lock_release (&cache_lock);
+      thread_yield ();
+      lock_acquire (&cache_lock);
+    }
+  e->pin_cnt++;
+  e->accessed = true;
+  lock_release (&cache_lock);
+
+  lock_acquire (&e->lock);
+  if (need_data && !e->loaded)
+    {
+      block_read (fs_device, sector, e->data);
+      e->loaded = true;
+    }
+  return e;
+}
+
+/* Releases entry E obtained from cache_pin(). */
+static void
+cache_unpin (struct cache_entry *e)
+{
+  lock_release (&e->lock);
+
+  lock_acquire (&cache_lock);
+  ASSERT (e->pin_cnt > 0);
+  e->pin_cnt--;
+  lock_release (&cache_lock);
+}
+
+/* Write-behind thread.  Periodically writes dirty sectors back
+   so that little is lost on a crash and evictions rarely have to
+   wait for a write. */
+static void
+write_behind (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&flush_sema);
+      cache_flush ();
+    }
+}
+
+/* Timer event function for flush_event.  Wakes the write-behind
+   thread if it is idle; if it is still busy with the previous
+   pass, this pass is skipped rather than queued.  Then rearms the
+   event one interval after its last expiry, so that the passes
+   keep to a fixed period however long each one takes. */
+static void
+flush_tick (void *aux UNUSED)
+{
+  if (!list_empty (&flush_sema.waiters))
+    sema_up (&flush_sema);
+  timer_event_schedule (&flush_event,
+                        flush_event.expires + CACHE_FLUSH_INTERVAL);
+}
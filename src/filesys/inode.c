@@ -1,107 +1,296 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
-#include <round.h>
+#include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of direct, indirect and doubly indirect data sectors
+   an inode can address. */
+#define DIRECT_CNT 124
+#define INDIRECT_CNT (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+#define DBL_INDIRECT_CNT (INDIRECT_CNT * INDIRECT_CNT)
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   Data sectors are found through a multi-level index: the first
+   DIRECT_CNT sectors directly, the next INDIRECT_CNT through the
+   index sector INDIRECT, and the rest through DBL_INDIRECT, an
+   index sector of index sectors.  A sector number of 0 (the free
+   map inode, never a data sector) marks a hole, which reads as
+   zeros and is allocated the first time it is written. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+    block_sector_t indirect;            /* Indirect index sector. */
+    block_sector_t dbl_indirect;        /* Doubly indirect index sector. */
   };
 
-/* Returns the number of sectors to allocate for an inode SIZE
-   bytes long. */
-static inline size_t
-bytes_to_sectors (off_t size)
-{
-  return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
-}
+/* In-memory inode.
 
-/* In-memory inode. */
+   Locking: ELEM and OPEN_CNT belong to open_inodes_lock.  RW is
+   held for reading while data is read and for writing while data
+   is written, since a write may allocate sectors and so change
+   DATA's index.  LENGTH is changed only with both RW held for
+   writing and META_LOCK held, so either one suffices to read it.
+   REMOVED and DENY_WRITE_CNT belong to META_LOCK.  LOCK is not
+   used by this module; see inode_lock().
+
+   RW is never held while user memory is touched.  A page fault
+   there may read a file or write back an mmap page, and so want
+   RW itself.  User buffers are copied a sector at a time through
+   a buffer on the stack, with RW released in between. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    unsigned write_cnt;                 /* Number of writes. */
+    struct rwlock rw;                   /* Guards the data and DATA. */
+    struct lock meta_lock;              /* Guards length and flags. */
+    struct lock lock;                   /* Held by inode_lock(). */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Writes INODE's in-memory copy of its on-disk inode back to its
+   sector. */
+static void
+inode_store (struct inode *inode)
+{
+  cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Allocates a sector, fills it with zeros and stores its number
+   into *SECTORP.  Returns true if successful, false if the disk
+   is full. */
+static bool
+allocate_zeroed (block_sector_t *sectorp)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (!free_map_allocate (1, sectorp))
+    return false;
+  cache_write (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Returns the sector in *SLOT, a member of INODE's on-disk inode.
+   If the slot is a hole and CREATE is true, allocates a zeroed
+   sector for it first.  Returns 0 for a hole or a failed
+   allocation. */
+static block_sector_t
+inode_slot (struct inode *inode, block_sector_t *slot, bool create)
+{
+  if (*slot == 0 && create && allocate_zeroed (slot))
+    inode_store (inode);
+  return *slot;
+}
+
+/* Returns entry IDX of index sector INDEX.  If the entry is a hole
+   and CREATE is true, allocates a zeroed sector for it first.
+   Returns 0 for a hole or a failed allocation. */
+static block_sector_t
+index_slot (block_sector_t index, size_t idx, bool create)
+{
+  block_sector_t sector;
+  off_t ofs = idx * sizeof sector;
+
+  cache_read (index, &sector, ofs, sizeof sector);
+  if (sector == 0 && create && allocate_zeroed (&sector))
+    cache_write (index, &sector, ofs, sizeof sector);
+  return sector;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   If that part of INODE is a hole, allocates a sector for it if
+   CREATE is true, otherwise returns 0.  Also returns 0 if POS is
+   beyond the largest possible file or allocation fails. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos, bool create)
 {
+  struct inode_disk *data = &inode->data;
+  size_t idx;
+  block_sector_t index;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
-    return -1;
+  ASSERT (pos >= 0);
+
+  idx = pos / BLOCK_SECTOR_SIZE;
+  if (idx < DIRECT_CNT)
+    return inode_slot (inode, &data->direct[idx], create);
+
+  idx -= DIRECT_CNT;
+  if (idx < INDIRECT_CNT)
+    {
+      index = inode_slot (inode, &data->indirect, create);
+      return index != 0 ? index_slot (index, idx, create) : 0;
+    }
+
+  idx -= INDIRECT_CNT;
+  if (idx < DBL_INDIRECT_CNT)
+    {
+      index = inode_slot (inode, &data->dbl_indirect, create);
+      if (index != 0)
+        index = index_slot (index, idx / INDIRECT_CNT, create);
+      return index != 0 ? index_slot (index, idx % INDIRECT_CNT, create) : 0;
+    }
+
+  return 0;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Releases index sector INDEX and, if LEVEL is greater than 0,
+   the LEVEL levels of sectors below it. */
+static void
+release_index (block_sector_t index, int level)
+{
+  if (level > 0)
+    {
+      block_sector_t *entries = malloc (BLOCK_SECTOR_SIZE);
+      size_t i;
+
+      if (entries != NULL)
+        {
+          cache_read (index, entries, 0, BLOCK_SECTOR_SIZE);
+          for (i = 0; i < INDIRECT_CNT; i++)
+            if (entries[i] != 0)
+              release_index (entries[i], level - 1);
+          free (entries);
+        }
+    }
+  free_map_release (index, 1);
+}
+
+/* Releases every data and index sector of INODE. */
+static void
+inode_release_sectors (struct inode *inode)
+{
+  struct inode_disk *data = &inode->data;
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (data->direct[i] != 0)
+      free_map_release (data->direct[i], 1);
+  if (data->indirect != 0)
+    release_index (data->indirect, 1);
+  if (data->dbl_indirect != 0)
+    release_index (data->dbl_indirect, 2);
+}
+
+/* Open inodes, keyed by sector, so that opening a single inode
+   twice returns the same `struct inode'. */
+static struct hash open_inodes;
+
+/* Protects open_inodes and every inode's open count. */
+static struct lock open_inodes_lock;
+
+/* Cache that in-memory inodes come from. */
+static struct slab_cache *inode_cache;
+
+/* Statistics. */
+static unsigned long long open_cnt;     /* Calls to inode_open(). */
+static unsigned long long compare_cnt;  /* Keys compared by lookups. */
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+static void inode_ctor (void *);
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&open_inodes, inode_hash, inode_less, NULL);
+  lock_init (&open_inodes_lock);
+  inode_cache = slab_cache_create ("inode", sizeof (struct inode),
+                                   inode_ctor);
+}
+
+/* Initializes the locks in INODE, which stay initialized while
+   it sits free in inode_cache. */
+static void
+inode_ctor (void *inode_)
+{
+  struct inode *inode = inode_;
+  rwlock_init (&inode->rw);
+  lock_init (&inode->meta_lock);
+  lock_init (&inode->lock);
+}
+
+/* Returns a hash value for the inode that contains E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct inode *inode = hash_entry (e, struct inode, elem);
+  return hash_int (inode->sector);
+}
+
+/* Returns true if the inode that contains A has a lower sector
+   number than the one that contains B. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  const struct inode *ia = hash_entry (a, struct inode, elem);
+  const struct inode *ib = hash_entry (b, struct inode, elem);
+
+  compare_cnt++;
+  return ia->sector < ib->sector;
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The data sectors are allocated one at a time, so they
+   need not be contiguous.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
 inode_create (block_sector_t sector, off_t length)
 {
-  struct inode_disk *disk_inode = NULL;
-  bool success = false;
+  struct inode *inode;
+  bool success = true;
+  off_t ofs;
 
   ASSERT (length >= 0);
 
   /* If this assertion fails, the inode structure is not exactly
      one sector in size, and you should fix that. */
-  ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof inode->data == BLOCK_SECTOR_SIZE);
+
+  inode = calloc (1, sizeof *inode);
+  if (inode == NULL)
+    return false;
 
-  disk_inode = calloc (1, sizeof *disk_inode);
-  if (disk_inode != NULL)
+  inode->sector = sector;
+  inode->data.magic = INODE_MAGIC;
+  for (ofs = 0; ofs < length; ofs += BLOCK_SECTOR_SIZE)
+    if (byte_to_sector (inode, ofs, true) == 0)
+      {
+        success = false;
+        break;
+      }
+
+  if (success)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
-      disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
-      free (disk_inode);
+      inode->data.length = length;
+      inode_store (inode);
     }
+  else
+    inode_release_sectors (inode);
+  free (inode);
   return success;
 }
 
@@ -111,33 +300,42 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
+  lock_acquire (&open_inodes_lock);
+  open_cnt++;
+
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+      return inode; 
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = slab_alloc (inode_cache);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  The inode is read while the list is still
+     locked so that nobody else can find it half-built. */
   inode->sector = sector;
+  hash_insert (&open_inodes, &inode->elem);
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->write_cnt = 0;
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +344,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -168,21 +370,25 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
+  lock_acquire (&open_inodes_lock);
   if (--inode->open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
+      /* Remove from inode list and release lock.  Nobody else
+         can reach INODE after this. */
+      hash_delete (&open_inodes, &inode->elem);
+      lock_release (&open_inodes_lock);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          inode_release_sectors (inode);
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
         }
 
-      free (inode); 
+      slab_free (inode_cache, inode); 
     }
+  else
+    lock_release (&open_inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -191,27 +397,27 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&inode->meta_lock);
   inode->removed = true;
+  lock_release (&inode->meta_lock);
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
-   Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+/* Reads SIZE bytes from INODE into kernel buffer BUFFER, starting
+   at position OFFSET.  Returns the number of bytes read.  INODE's
+   RW must be held. */
+static off_t
+read_data (struct inode *inode, uint8_t *buffer, off_t size, off_t offset)
 {
-  uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = byte_to_sector (inode, offset, false);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = inode->data.length - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -220,110 +426,204 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      /* Copy out of the buffer cache.  A hole reads as zeros. */
+      if (sector_idx != 0)
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
-
   return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
-   Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
-off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset) 
+/* Writes SIZE bytes from kernel buffer BUFFER into INODE, starting
+   at OFFSET, and extends INODE if it ends past end of file.
+   Returns the number of bytes written.  INODE's RW must be held
+   for writing. */
+static off_t
+write_data (struct inode *inode, const uint8_t *buffer, off_t size,
+            off_t offset)
 {
-  const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
-
-  if (inode->deny_write_cnt)
-    return 0;
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = byte_to_sector (inode, offset, true);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
-
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int chunk_size = size < sector_left ? size : sector_left;
+      if (sector_idx == 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      /* Write into the buffer cache.  A partial sector is read in
+         first by the cache, and the disk write is deferred. */
+      cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+                   chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
+  if (bytes_written > 0)
+    inode->write_cnt++;
+
+  /* Extend the file only once the data is in place. */
+  if (bytes_written > 0 && offset > inode->data.length)
+    {
+      lock_acquire (&inode->meta_lock);
+      inode->data.length = offset;
+      lock_release (&inode->meta_lock);
+      inode_store (inode);
+    }
   return bytes_written;
 }
 
-/* Disables writes to INODE.
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached. */
+off_t
+inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+{
+  uint8_t *buffer = buffer_;
+  off_t bytes_read = 0;
+
+  if (size <= 0 || !is_user_vaddr (buffer))
+    {
+      rwlock_acquire_read (&inode->rw);
+      bytes_read = read_data (inode, buffer, size, offset);
+      rwlock_release_read (&inode->rw);
+      return bytes_read;
+    }
+
+  /* Read a sector at a time into a buffer on the stack, then copy
+     it out with RW released. */
+  while (size > 0)
+    {
+      uint8_t bounce[BLOCK_SECTOR_SIZE];
+      off_t sector_left = BLOCK_SECTOR_SIZE - offset % BLOCK_SECTOR_SIZE;
+      off_t chunk_size = size < sector_left ? size : sector_left;
+      off_t chunk_read;
+
+      rwlock_acquire_read (&inode->rw);
+      chunk_read = read_data (inode, bounce, chunk_size, offset);
+      rwlock_release_read (&inode->rw);
+
+      memcpy (buffer + bytes_read, bounce, chunk_read);
+      size -= chunk_read;
+      offset += chunk_read;
+      bytes_read += chunk_read;
+      if (chunk_read < chunk_size)
+        break;
+    }
+
+  return bytes_read;
+}
+
+/* Returns true if writes to INODE are denied.  Must be called
+   with RW held for writing, which inode_deny_write() also takes,
+   so a write either finishes before the denial or sees it. */
+static bool
+write_denied (struct inode *inode)
+{
+  bool denied;
+
+  lock_acquire (&inode->meta_lock);
+  denied = inode->deny_write_cnt > 0;
+  lock_release (&inode->meta_lock);
+  return denied;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if the disk fills up or an error occurs.
+   Writing past end of file extends INODE, allocating sectors
+   only for the parts actually written; any gap between the old
+   end of file and OFFSET is left as a hole. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+                off_t offset) 
+{
+  const uint8_t *buffer = buffer_;
+  off_t bytes_written = 0;
+
+  if (size <= 0 || !is_user_vaddr (buffer))
+    {
+      rwlock_acquire_write (&inode->rw);
+      if (!write_denied (inode))
+        bytes_written = write_data (inode, buffer, size, offset);
+      rwlock_release_write (&inode->rw);
+      return bytes_written;
+    }
+
+  /* Copy a sector at a time into a buffer on the stack with RW
+     released, then write it. */
+  while (size > 0)
+    {
+      uint8_t bounce[BLOCK_SECTOR_SIZE];
+      off_t sector_left = BLOCK_SECTOR_SIZE - offset % BLOCK_SECTOR_SIZE;
+      off_t chunk_size = size < sector_left ? size : sector_left;
+      off_t chunk_written = 0;
+
+      memcpy (bounce, buffer + bytes_written, chunk_size);
+
+      rwlock_acquire_write (&inode->rw);
+      if (!write_denied (inode))
+        chunk_written = write_data (inode, bounce, chunk_size, offset);
+      rwlock_release_write (&inode->rw);
+
+      size -= chunk_written;
+      offset += chunk_written;
+      bytes_written += chunk_written;
+      if (chunk_written < chunk_size)
+        break;
+    }
+
+  return bytes_written;
+}
+
+/* Returns the number of writes to INODE so far.  A copy of
+   INODE's data that was made when this returned the same value
+   is still current. */
+unsigned
+inode_write_cnt (const struct inode *inode)
+{
+  return inode->write_cnt;
+}
+
+/* Returns true if INODE has been removed, so that its blocks
+   are freed once the last opener closes it. */
+bool
+inode_is_removed (struct inode *inode)
+{
+  bool removed;
+
+  lock_acquire (&inode->meta_lock);
+  removed = inode->removed;
+  lock_release (&inode->meta_lock);
+  return removed;
+}
+
+/* Disables writes to INODE.  Waits for a write in progress to
+   finish, so that none is running once this returns.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
+  lock_acquire (&inode->meta_lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->meta_lock);
+  rwlock_release_write (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -332,14 +632,46 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&inode->meta_lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&inode->meta_lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
 off_t
-inode_length (const struct inode *inode)
+inode_length (struct inode *inode)
+{
+  off_t length;
+
+  lock_acquire (&inode->meta_lock);
+  length = inode->data.length;
+  lock_release (&inode->meta_lock);
+  return length;
+}
+
+/* Prints inode statistics. */
+void
+inode_print_stats (void)
+{
+  printf ("Inodes: %llu opens, %llu key comparisons\n",
+          open_cnt, compare_cnt);
+}
+
+/* Acquires INODE's lock, which serializes operations made of
+   several reads and writes of INODE, such as directory updates.
+   Must not be called while holding any other inode's data
+   locked. */
+void
+inode_lock (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+}
+
+/* Releases INODE's lock. */
+void
+inode_unlock (struct inode *inode)
 {
-  return inode->data.length;
+  lock_release (&inode->lock);
 }
@@ -14,10 +14,15 @@ struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+bool inode_is_removed (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
-off_t inode_length (const struct inode *);
+unsigned inode_write_cnt (const struct inode *);
+off_t inode_length (struct inode *);
+void inode_lock (struct inode *);
+void inode_unlock (struct inode *);
+void inode_print_stats (void);
 
 #endif /* filesys/inode.h */
@@ -28,6 +28,7 @@ struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    elem_type *summary; /* Bit I set iff bits[I] is full, or null. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -69,6 +70,50 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns true if every bit in B's element IDX that is part of
+   the bitmap is set to true. */
+static inline bool
+elem_full (const struct bitmap *b, size_t idx)
+{
+  elem_type used = idx == elem_cnt (b->bit_cnt) - 1 ? last_mask (b) : (elem_type) -1;
+  return (b->bits[idx] & used) == used;
+}
+
+/* Brings the summary bit for B's element IDX up to date. */
+static inline void
+update_summary (struct bitmap *b, size_t idx)
+{
+  if (b->summary != NULL)
+    {
+      if (elem_full (b, idx))
+        b->summary[elem_idx (idx)] |= bit_mask (idx);
+      else
+        b->summary[elem_idx (idx)] &= ~bit_mask (idx);
+    }
+}
+
+/* Sets the bits in MASK in B's element IDX to true. */
+static inline void
+mark_bits (struct bitmap *b, size_t idx, elem_type mask)
+{
+  /* This is equivalent to `b->bits[idx] |= mask' except that it
+     is guaranteed to be atomic on a uniprocessor machine.  See
+     the description of the OR instruction in [IA32-v2b]. */
+  asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, idx);
+}
+
+/* Sets the bits in MASK in B's element IDX to false. */
+static inline void
+reset_bits (struct bitmap *b, size_t idx, elem_type mask)
+{
+  /* This is equivalent to `b->bits[idx] &= ~mask' except that it
+     is guaranteed to be atomic on a uniprocessor machine.  See
+     the description of the AND instruction in [IA32-v2a]. */
+  asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  update_summary (b, idx);
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -83,6 +128,7 @@ bitmap_create (size_t bit_cnt)
     {
       b->bit_cnt = bit_cnt;
       b->bits = malloc (byte_cnt (bit_cnt));
+      b->summary = NULL;
       if (b->bits != NULL || bit_cnt == 0)
         {
           bitmap_set_all (b, false);
@@ -105,6 +151,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
+  b->summary = NULL;
   bitmap_set_all (b, false);
   return b;
 }
@@ -125,10 +172,40 @@ bitmap_destroy (struct bitmap *b)
   if (b != NULL) 
     {
       free (b->bits);
+      free (b->summary);
       free (b);
     }
 }
 
+/* Adds a summary level to B: one bit per element of B, set when
+   that element has no bits set to false.  Scans for false bits
+   then skip a full element's worth of bits per summary bit, so
+   a scan of a nearly full bitmap touches about 1/32 as much
+   memory.  Worth it only for large bitmaps.
+
+   Keeping the summary in step is not atomic with the change it
+   reflects, so all changes to B must be serialized by the
+   caller once this has been called.  Returns true if
+   successful, false if memory allocation failed. */
+bool
+bitmap_add_summary (struct bitmap *b)
+{
+  size_t idx;
+
+  ASSERT (b != NULL);
+
+  if (b->summary == NULL)
+    {
+      size_t cnt = elem_cnt (elem_cnt (b->bit_cnt));
+      b->summary = calloc (cnt > 0 ? cnt : 1, sizeof *b->summary);
+      if (b->summary == NULL)
+        return false;
+    }
+  for (idx = 0; idx < elem_cnt (b->bit_cnt); idx++)
+    update_summary (b, idx);
+  return true;
+}
+
 /* Bitmap size. */
 
 /* Returns the number of bits in B. */
@@ -156,26 +233,14 @@ bitmap_set (struct bitmap *b, size_t idx, bool value)
 void
 bitmap_mark (struct bitmap *b, size_t bit_idx) 
 {
-  size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
-
-  /* This is equivalent to `b->bits[idx] |= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the OR instruction in [IA32-v2b]. */
-  asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  mark_bits (b, elem_idx (bit_idx), bit_mask (bit_idx));
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
 void
 bitmap_reset (struct bitmap *b, size_t bit_idx) 
 {
-  size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
-
-  /* This is equivalent to `b->bits[idx] &= ~mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the AND instruction in [IA32-v2a]. */
-  asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  reset_bits (b, elem_idx (bit_idx), bit_mask (bit_idx));
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -191,6 +256,7 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -204,6 +270,61 @@ bitmap_test (const struct bitmap *b, size_t idx)
 
 /* Setting and testing multiple bits. */
 
+/* Returns the index of the first element at or after IDX, but
+   before END_IDX, that the summary of B says is not full, or
+   END_IDX if there is none. */
+static size_t
+next_open_elem (const struct bitmap *b, size_t idx, size_t end_idx)
+{
+  size_t sidx = elem_idx (idx);
+  size_t send = elem_cnt (end_idx);
+  elem_type word = ~b->summary[sidx] & ((elem_type) -1 << (idx % ELEM_BITS));
+
+  while (word == 0)
+    {
+      if (++sidx >= send)
+        return end_idx;
+      word = ~b->summary[sidx];
+    }
+  idx = sidx * ELEM_BITS + __builtin_ctzl (word);
+  return idx < end_idx ? idx : end_idx;
+}
+
+/* Returns the index of the first bit in B at or after START, but
+   before END, that is set to VALUE, or END if there is none.
+   Works an element at a time, so that runs of bits set to
+   !VALUE cost one comparison per ELEM_BITS bits, and a
+   find-first-set instruction picks out the bit within an
+   element. */
+static size_t
+find_bit (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t end_idx, idx, bit;
+  elem_type word;
+
+  if (start >= end)
+    return end;
+
+  end_idx = elem_cnt (end);
+  idx = elem_idx (start);
+  word = (b->bits[idx] ^ flip) & ((elem_type) -1 << (start % ELEM_BITS));
+  while (word == 0)
+    {
+      if (++idx >= end_idx)
+        return end;
+      if (!value && b->summary != NULL)
+        {
+          idx = next_open_elem (b, idx, end_idx);
+          if (idx >= end_idx)
+            return end;
+        }
+      word = b->bits[idx] ^ flip;
+    }
+  bit = idx * ELEM_BITS + __builtin_ctzl (word);
+  return bit < end ? bit : end;
+}
+
 /* Sets all bits in B to VALUE. */
 void
 bitmap_set_all (struct bitmap *b, bool value) 
@@ -217,14 +338,24 @@ bitmap_set_all (struct bitmap *b, bool value)
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (cnt > 0)
+    {
+      size_t idx = elem_idx (start);
+      size_t ofs = start % ELEM_BITS;
+      size_t n = ELEM_BITS - ofs < cnt ? ELEM_BITS - ofs : cnt;
+      elem_type mask = n < ELEM_BITS ? ((elem_type) 1 << n) - 1 : (elem_type) -1;
+
+      if (value)
+        mark_bits (b, idx, mask << ofs);
+      else
+        reset_bits (b, idx, mask << ofs);
+      start += n;
+      cnt -= n;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -232,16 +363,22 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
+  /* Add up the lengths of the runs of VALUE bits. */
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  start = find_bit (b, start, end, value);
+  while (start < end)
+    {
+      size_t run_end = find_bit (b, start, end, !value);
+      value_cnt += run_end - start;
+      start = find_bit (b, run_end, end, value);
+    }
   return value_cnt;
 }
 
@@ -250,16 +387,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_bit (b, start, start + cnt, value) != start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -298,13 +430,28 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      /* Jump from run to run of VALUE bits instead of trying
+         every starting index: a run that is too short is
+         skipped in one step, past the !VALUE bit that ends it. */
+      for (;;)
+        {
+          size_t run_end;
+
+          i = find_bit (b, i, b->bit_cnt, value);
+          if (i > last)
+            break;
+          run_end = find_bit (b, i, i + cnt, !value);
+          if (run_end == i + cnt)
+            return i;
+          i = run_end;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -346,6 +493,8 @@ bitmap_read (struct bitmap *b, struct file *file)
       off_t size = byte_cnt (b->bit_cnt);
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      if (b->summary != NULL)
+        bitmap_add_summary (b);
     }
   return success;
 }
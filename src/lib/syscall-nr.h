@@ -31,7 +31,10 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Added after the stock numbering so existing numbers stay fixed. */
+    SYS_FORK                    /* Clone this process. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -167,6 +167,12 @@ int max_of_four_int (int a, int b, int c, int d) {
   return syscall4 (SYS_MAX_OF_FOUR_INT, a, b, c, d);
 }
 
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
 
 mapid_t
 mmap (int fd, void *addr)
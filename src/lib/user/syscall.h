@@ -36,6 +36,7 @@ void close (int fd);
 
 int fibonacci (int n);
 int max_of_four_int (int a, int b, int c, int d);
+pid_t fork (void);
 
 /* Project 3 and optionally project 4. */
 mapid_t mmap (int fd, void *addr);
@@ -0,0 +1,52 @@
+/* Creates FILE_CNT files and keeps them all open, then opens and
+   closes each of them ROUND_CNT more times, for thousands of
+   opens in all.  Every open has to find an already-open inode
+   among FILE_CNT others, so the "Inodes:" line that the kernel
+   prints at shutdown shows how much each lookup costs. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 100
+#define ROUND_CNT 20
+
+static int fds[FILE_CNT];
+
+void
+test_main (void) 
+{
+  char file_name[16];
+  int round, i;
+
+  msg ("creating and opening %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "file%d", i);
+      if (!create (file_name, 0))
+        fail ("create \"%s\"", file_name);
+      fds[i] = open (file_name);
+      if (fds[i] < 2)
+        fail ("open \"%s\"", file_name);
+    }
+
+  msg ("opening each file %d more times", ROUND_CNT);
+  for (round = 0; round < ROUND_CNT; round++)
+    for (i = 0; i < FILE_CNT; i++)
+      {
+        int fd;
+
+        snprintf (file_name, sizeof file_name, "file%d", i);
+        fd = open (file_name);
+        if (fd < 2)
+          fail ("open \"%s\" in round %d", file_name, round);
+        if (fd == fds[i])
+          fail ("open \"%s\" returned fd %d twice", file_name, fd);
+        close (fd);
+      }
+
+  msg ("closing %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    close (fds[i]);
+}
@@ -0,0 +1,155 @@
+/* Checks bitmap_scan() in lib/kernel/bitmap.c against a
+   bit-at-a-time reference scan and then measures the cost of
+   allocating from nearly full bitmaps, the case palloc, the free
+   map, and swap slot allocation hit when memory or disk is
+   short.  Each size is timed three ways: with the reference
+   scan, with bitmap_scan(), and with bitmap_scan() on a bitmap
+   that has a summary level. */
+
+#include <bitmap.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "devices/timer.h"
+
+/* Number of scans to time for each bitmap size. */
+#define SCAN_CNT 2000
+
+/* One group of bits in FREE_RATIO is left free in the nearly
+   full maps. */
+#define FREE_RATIO 100
+
+static size_t reference_scan (const struct bitmap *, size_t start,
+                              size_t cnt, bool value);
+static void verify_scan (size_t bit_cnt);
+static void fill_nearly_full (struct bitmap *);
+static int64_t time_scans (struct bitmap *, size_t cnt, bool reference);
+
+void
+test_bitmap_scan (void) 
+{
+  static const size_t sizes[] = {1024, 8192, 65536};
+  size_t i;
+
+  for (i = 1; i < 2048; i = i * 3 / 2 + 1)
+    verify_scan (i);
+  msg ("bitmap_scan matches the reference scan.");
+
+  msg ("%d scans for 1 and 4 free bits, in ticks "
+       "(reference / word / summary):", SCAN_CNT);
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      struct bitmap *b = bitmap_create (sizes[i]);
+      struct bitmap *s = bitmap_create (sizes[i]);
+
+      if (b == NULL || s == NULL || !bitmap_add_summary (s))
+        fail ("out of memory");
+      fill_nearly_full (b);
+      fill_nearly_full (s);
+
+      msg ("%6zu bits:  %"PRId64" / %"PRId64" / %"PRId64
+           "  %"PRId64" / %"PRId64" / %"PRId64, sizes[i],
+           time_scans (b, 1, true), time_scans (b, 1, false),
+           time_scans (s, 1, false), time_scans (b, 4, true),
+           time_scans (b, 4, false), time_scans (s, 4, false));
+
+      bitmap_destroy (b);
+      bitmap_destroy (s);
+    }
+  msg ("PASS");
+}
+
+/* The scan bitmap_scan() used to do: try every starting index
+   and test each bit of the group in turn. */
+static size_t
+reference_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i, j;
+
+  if (cnt == 0)
+    return start;
+  for (i = start; i + cnt <= bitmap_size (b); i++)
+    {
+      for (j = 0; j < cnt; j++)
+        if (bitmap_test (b, i + j) != value)
+          break;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Compares bitmap_scan() against reference_scan() on randomly
+   filled bitmaps with BIT_CNT bits, with and without a
+   summary. */
+static void
+verify_scan (size_t bit_cnt)
+{
+  int repeat;
+
+  for (repeat = 0; repeat < 20; repeat++)
+    {
+      struct bitmap *b = bitmap_create (bit_cnt);
+      unsigned density = random_ulong () % 101;
+      size_t i;
+
+      if (b == NULL || (repeat % 2 && !bitmap_add_summary (b)))
+        fail ("out of memory");
+      for (i = 0; i < bit_cnt; i++)
+        if (random_ulong () % 100 < density)
+          bitmap_mark (b, i);
+
+      for (i = 0; i < 50; i++)
+        {
+          size_t start = random_ulong () % (bit_cnt + 1);
+          size_t cnt = random_ulong () % 10;
+          bool value = random_ulong () % 2;
+
+          size_t idx = bitmap_scan (b, start, cnt, value);
+          size_t expected = reference_scan (b, start, cnt, value);
+
+          if (idx != expected)
+            fail ("bitmap_scan (%zu bits, start %zu, cnt %zu, %s) "
+                  "returned %zu instead of %zu", bit_cnt, start, cnt,
+                  value ? "true" : "false", idx, expected);
+        }
+      bitmap_destroy (b);
+    }
+}
+
+/* Marks all of B except for every FREE_RATIO'th group of four
+   bits, so that the free space is spread out thinly. */
+static void
+fill_nearly_full (struct bitmap *b)
+{
+  size_t i;
+
+  bitmap_set_all (b, true);
+  for (i = bitmap_size (b) / 2; i + 4 <= bitmap_size (b);
+       i += FREE_RATIO * 4)
+    bitmap_set_multiple (b, i, 4, false);
+}
+
+/* Times SCAN_CNT allocations and frees of CNT bits from B, using
+   reference_scan() if REFERENCE is true and bitmap_scan()
+   otherwise.  Returns the elapsed timer ticks. */
+static int64_t
+time_scans (struct bitmap *b, size_t cnt, bool reference)
+{
+  int64_t start = timer_ticks ();
+  int i;
+
+  for (i = 0; i < SCAN_CNT; i++)
+    {
+      size_t idx = (reference
+                    ? reference_scan (b, 0, cnt, false)
+                    : bitmap_scan (b, 0, cnt, false));
+      if (idx == BITMAP_ERROR)
+        fail ("no %zu free bits in a nearly full bitmap", cnt);
+      bitmap_set_multiple (b, idx, cnt, true);
+      bitmap_set_multiple (b, idx, cnt, false);
+    }
+  return timer_elapsed (start);
+}
@@ -0,0 +1,147 @@
+/* The main thread holds a lock at the end of a chain of DEPTH
+   locks, each held by a thread waiting for the next, while
+   medium-priority threads keep the CPU busy.  A high-priority
+   thread then waits for the lock at the head of the chain.
+   Without donation, the main thread would not run again until
+   the medium-priority threads finished, and the high-priority
+   thread would wait about SPIN_TICKS ticks.  With donation, the
+   wait is bounded by the main thread's critical section,
+   HOLD_MS milliseconds, however long the chain. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Longest chain of lock holders to try. */
+#define MAX_DEPTH 8
+
+/* Number of medium-priority threads, and how long each keeps
+   the CPU busy. */
+#define SPIN_CNT 3
+#define SPIN_TICKS (TIMER_FREQ * 2)
+
+/* Length of the main thread's critical section. */
+#define HOLD_MS 50
+
+struct chain
+  {
+    struct lock locks[MAX_DEPTH];
+    int depth;
+    int links;                  /* Link threads started so far. */
+    struct semaphore done;
+    int64_t wait;               /* Ticks the high thread waited. */
+  };
+
+static thread_func link_thread, spin_thread, high_thread;
+static int64_t measure (int depth);
+
+void
+test_priority_donate_wait (void) 
+{
+  static const int depths[] = {1, 4, MAX_DEPTH};
+  size_t i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  for (i = 0; i < sizeof depths / sizeof *depths; i++)
+    {
+      int64_t wait = measure (depths[i]);
+
+      if (wait >= SPIN_TICKS)
+        fail ("%d holder(s) deep: high thread waited %"PRId64" ticks, "
+              "not bounded by donation.", depths[i], wait);
+      msg ("%d holder(s) deep: high thread got the lock in time.",
+           depths[i]);
+    }
+}
+
+/* Sets up a chain of DEPTH lock holders ending in the current
+   thread and returns how long the high-priority thread waits
+   for the head of the chain. */
+static int64_t
+measure (int depth)
+{
+  struct chain c;
+  int i;
+
+  c.depth = depth;
+  c.links = 0;
+  for (i = 0; i < depth; i++)
+    lock_init (&c.locks[i]);
+  sema_init (&c.done, 0);
+
+  /* Hold the tail of the chain.  Each link thread runs as soon
+     as it is created, takes its own lock, and waits for the
+     previous one. */
+  thread_set_priority (PRI_DEFAULT);
+  lock_acquire (&c.locks[0]);
+  for (i = 1; i < depth; i++)
+    thread_create ("link", PRI_DEFAULT + 1, link_thread, &c);
+
+  /* Create the competing threads without being preempted, then
+     drop below them. */
+  thread_set_priority (PRI_MAX);
+  for (i = 0; i < SPIN_CNT; i++)
+    thread_create ("spin", PRI_DEFAULT + 10, spin_thread, &c);
+  thread_create ("high", PRI_MAX - 1, high_thread, &c);
+  thread_set_priority (PRI_MIN);
+
+  /* Runs only once the high thread donates to us. */
+  timer_mdelay (HOLD_MS);
+  lock_release (&c.locks[0]);
+
+  for (i = 0; i < depth - 1 + SPIN_CNT + 1; i++)
+    sema_down (&c.done);
+  thread_set_priority (PRI_DEFAULT);
+  return c.wait;
+}
+
+/* Takes the next lock in the chain, then waits for the one
+   before it. */
+static void
+link_thread (void *c_)
+{
+  struct chain *c = c_;
+  int idx = ++c->links;
+
+  lock_acquire (&c->locks[idx]);
+  lock_acquire (&c->locks[idx - 1]);
+  lock_release (&c->locks[idx - 1]);
+  lock_release (&c->locks[idx]);
+  sema_up (&c->done);
+}
+
+/* Keeps the CPU busy for SPIN_TICKS ticks. */
+static void
+spin_thread (void *c_)
+{
+  struct chain *c = c_;
+  int64_t start = timer_ticks ();
+
+  while (timer_elapsed (start) < SPIN_TICKS)
+    continue;
+  sema_up (&c->done);
+}
+
+/* Waits a little for the competing threads to take over the CPU,
+   then measures how long it takes to get the head of the
+   chain. */
+static void
+high_thread (void *c_)
+{
+  struct chain *c = c_;
+  struct lock *head = &c->locks[c->depth - 1];
+  int64_t start;
+
+  timer_sleep (5);
+  start = timer_ticks ();
+  lock_acquire (head);
+  c->wait = timer_elapsed (start);
+  lock_release (head);
+  sema_up (&c->done);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-wait) begin
+(priority-donate-wait) 1 holder(s) deep: high thread got the lock in time.
+(priority-donate-wait) 4 holder(s) deep: high thread got the lock in time.
+(priority-donate-wait) 8 holder(s) deep: high thread got the lock in time.
+(priority-donate-wait) end
+EOF
+pass;
@@ -0,0 +1,148 @@
+/* Checks memcpy(), memmove() and memset() in lib/string.c
+   against byte-at-a-time reference loops at every combination of
+   small misalignments and a range of sizes.  It then reports the
+   throughput of each routine, in bytes per timer tick, for
+   page-sized blocks and for odd-sized, misaligned blocks. */
+
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "devices/timer.h"
+
+/* Size of the test buffers. */
+#define BUF_SIZE 8192
+
+/* Ticks to run each benchmark for. */
+#define BENCH_TICKS 50
+
+static uint8_t buf_a[BUF_SIZE], buf_b[BUF_SIZE], buf_ref[BUF_SIZE];
+
+enum op { OP_MEMCPY, OP_MEMMOVE, OP_MEMSET };
+static const char *op_names[] = {"memcpy", "memmove", "memset"};
+
+static void verify (void);
+static void reference (enum op, uint8_t *, size_t dst, size_t src,
+                       size_t size, int value);
+static void run (enum op, uint8_t *, size_t dst, size_t src,
+                 size_t size, int value);
+static int64_t bench (enum op, size_t dst, size_t src, size_t size);
+
+void
+test_string_blocks (void) 
+{
+  enum op op;
+
+  verify ();
+
+  msg ("bytes per tick, page aligned and misaligned by 1 and 3:");
+  for (op = OP_MEMCPY; op <= OP_MEMSET; op++)
+    msg ("%-8s %10"PRId64" %10"PRId64, op_names[op],
+         bench (op, 0, 4096, 4096), bench (op, 1, 4096 + 3, 4093));
+  msg ("PASS");
+}
+
+/* Checks each routine against the reference loops. */
+static void
+verify (void)
+{
+  size_t size;
+
+  for (size = 0; size < 600; size = size * 5 / 4 + 1)
+    {
+      size_t dst, src;
+      enum op op;
+
+      for (op = OP_MEMCPY; op <= OP_MEMSET; op++)
+        for (dst = 0; dst < 8; dst++)
+          for (src = 0; src < 8; src++)
+            {
+              size_t i;
+              int value = random_ulong ();
+
+              /* memcpy() must not be given overlapping blocks. */
+              size_t src_ofs = op == OP_MEMCPY ? src + 1024 : src;
+
+              for (i = 0; i < 2048; i++)
+                buf_a[i] = buf_ref[i] = random_ulong ();
+              run (op, buf_a, dst, src_ofs, size, value);
+              reference (op, buf_ref, dst, src_ofs, size, value);
+              if (memcmp (buf_a, buf_ref, 2048))
+                fail ("%s wrong for size %zu, dst %zu, src %zu",
+                      op_names[op], size, dst, src_ofs);
+            }
+    }
+  msg ("memcpy, memmove and memset match the reference loops.");
+}
+
+/* Performs OP on BUF the slow way. */
+static void
+reference (enum op op, uint8_t *buf, size_t dst, size_t src, size_t size,
+           int value)
+{
+  size_t i;
+
+  switch (op)
+    {
+    case OP_MEMCPY:
+      for (i = 0; i < size; i++)
+        buf[dst + i] = buf[src + i];
+      break;
+    case OP_MEMMOVE:
+      for (i = 0; i < size; i++)
+        buf_b[i] = buf[src + i];
+      for (i = 0; i < size; i++)
+        buf[dst + i] = buf_b[i];
+      break;
+    case OP_MEMSET:
+      for (i = 0; i < size; i++)
+        buf[dst + i] = value;
+      break;
+    }
+}
+
+/* Performs OP on BUF with the routine under test. */
+static void
+run (enum op op, uint8_t *buf, size_t dst, size_t src, size_t size,
+     int value)
+{
+  void *result = NULL;
+
+  switch (op)
+    {
+    case OP_MEMCPY:
+      result = memcpy (buf + dst, buf + src, size);
+      break;
+    case OP_MEMMOVE:
+      result = memmove (buf + dst, buf + src, size);
+      break;
+    case OP_MEMSET:
+      result = memset (buf + dst, value, size);
+      break;
+    }
+  if (result != buf + dst)
+    fail ("%s returned the wrong pointer", op_names[op]);
+}
+
+/* Runs OP on SIZE-byte blocks at offsets DST and SRC in buf_a
+   for BENCH_TICKS timer ticks and returns the throughput. */
+static int64_t
+bench (enum op op, size_t dst, size_t src, size_t size)
+{
+  int64_t start, bytes = 0;
+
+  /* Start on a tick boundary. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    continue;
+
+  start = timer_ticks ();
+  while (timer_elapsed (start) < BENCH_TICKS)
+    {
+      run (op, buf_a, dst, src, size, 0);
+      bytes += size;
+    }
+  return bytes / BENCH_TICKS;
+}
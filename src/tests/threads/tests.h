@@ -20,6 +20,7 @@ extern test_func test_priority_donate_sema;
 extern test_func test_priority_donate_nest;
 extern test_func test_priority_donate_lower;
 extern test_func test_priority_donate_chain;
+extern test_func test_priority_donate_wait;
 extern test_func test_priority_fifo;
 extern test_func test_priority_lifo;
 extern test_func test_priority_preempt;
@@ -35,6 +36,8 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_string_blocks;
+extern test_func test_bitmap_scan;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
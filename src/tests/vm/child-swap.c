@@ -0,0 +1,46 @@
+/* Child process of page-swap-par.
+   Fills 1 MB with a pattern unique to each page and to its
+   process, then sweeps over it several times checking and
+   rewriting the pattern, so that pages keep moving to and from
+   swap while other children do the same. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (1024 * 1024)
+#define PAGE_SIZE 4096
+#define PAGE_CNT (SIZE / PAGE_SIZE)
+#define PASS_CNT 4
+
+static char buf[SIZE];
+
+int
+main (int argc, char *argv[])
+{
+  int id = argc > 1 ? atoi (argv[1]) : 0;
+  int pass;
+  size_t i;
+
+  test_name = "child-swap";
+
+  for (i = 0; i < PAGE_CNT; i++)
+    memset (buf + i * PAGE_SIZE, (i + id) & 0xff, PAGE_SIZE);
+
+  for (pass = 1; pass <= PASS_CNT; pass++)
+    for (i = 0; i < PAGE_CNT; i++)
+      {
+        char *page = buf + i * PAGE_SIZE;
+        char expected = (i + id + pass - 1) & 0xff;
+        size_t j;
+
+        for (j = 0; j < PAGE_SIZE; j += 512)
+          if (page[j] != expected)
+            fail ("pass %d: byte %zu is %d, expected %d",
+                  pass, i * PAGE_SIZE + j, page[j], expected);
+        memset (page, expected + 1, PAGE_SIZE);
+      }
+
+  return 0x42;
+}
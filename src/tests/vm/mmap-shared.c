@@ -0,0 +1,51 @@
+/* Maps a file and writes to it, then forks a child that maps
+   the same file again at another address.  The child must see
+   the parent's data, which has not been written back yet, and
+   the parent must see what the child writes through its own
+   mapping, without either mapping being unmapped first.  Both
+   hold only if every mapping of a file page shares one frame. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+#define CHILD_ACTUAL ((void *) 0x20000000)
+
+static const char message[] = "written through the child's mapping";
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  pid_t child;
+
+  CHECK (create ("sample.txt", strlen (sample)), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (ACTUAL, sample, strlen (sample));
+
+  child = fork ();
+  if (child == 0)
+    {
+      /* Stay quiet unless something is wrong, since our output
+         would race with the parent's. */
+      int child_handle = open ("sample.txt");
+
+      if (child_handle < 2 || mmap (child_handle, CHILD_ACTUAL) == MAP_FAILED)
+        fail ("child could not map \"sample.txt\"");
+      if (memcmp (CHILD_ACTUAL, sample, strlen (sample)))
+        fail ("child's mapping does not show the parent's data");
+      memcpy (CHILD_ACTUAL, message, sizeof message);
+      exit (0x42);
+    }
+  CHECK (child != PID_ERROR, "fork");
+  CHECK (wait (child) == 0x42, "wait for child");
+  CHECK (!memcmp (ACTUAL, message, sizeof message),
+         "compare mapped data against child's write");
+  munmap (map);
+  close (handle);
+}
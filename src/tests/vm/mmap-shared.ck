@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-shared) begin
+(mmap-shared) create "sample.txt"
+(mmap-shared) open "sample.txt"
+(mmap-shared) mmap "sample.txt"
+(mmap-shared) fork
+(mmap-shared) wait for child
+(mmap-shared) compare mapped data against child's write
+(mmap-shared) end
+EOF
+pass;
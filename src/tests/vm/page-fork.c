@@ -0,0 +1,51 @@
+/* Fills 2 MB of memory, forks, and has the child overwrite the
+   first half while the parent waits.  Afterward the parent's
+   copy must be unchanged.  With copy-on-write, only the pages
+   the child writes are copied. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+
+static char buf[SIZE];
+
+/* Fails unless SIZE bytes of buf starting at OFS are all
+   VALUE. */
+static void
+verify (size_t ofs, size_t size, char value)
+{
+  size_t i;
+
+  for (i = ofs; i < ofs + size; i++)
+    if (buf[i] != value)
+      fail ("byte %zu != %#x", i, (unsigned char) value);
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+
+  msg ("initialize");
+  memset (buf, 0x5a, sizeof buf);
+
+  child = fork ();
+  if (child == 0)
+    {
+      /* Stay quiet unless something is wrong, since our output
+         would race with the parent's. */
+      verify (0, SIZE, 0x5a);
+      memset (buf, 0xa5, SIZE / 2);
+      verify (0, SIZE / 2, 0xa5);
+      verify (SIZE / 2, SIZE / 2, 0x5a);
+      exit (0x42);
+    }
+  CHECK (child != PID_ERROR, "fork");
+  CHECK (wait (child) == 0x42, "wait for child");
+
+  msg ("read pass");
+  verify (0, SIZE, 0x5a);
+}
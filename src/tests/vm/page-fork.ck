@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fork) begin
+(page-fork) initialize
+(page-fork) fork
+(page-fork) wait for child
+(page-fork) read pass
+(page-fork) end
+EOF
+pass;
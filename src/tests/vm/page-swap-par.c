@@ -0,0 +1,31 @@
+/* Runs 4 child-swap processes at once.  Together they touch far
+   more memory than fits in physical memory, so each child's
+   sweeps keep several page faults waiting on swap at the same
+   time.  The swap and timer statistics printed at shutdown give
+   the throughput, and the .ck file checks that at least two swap
+   transfers were in flight at once. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      char cmd_line[32];
+      snprintf (cmd_line, sizeof cmd_line, "child-swap %d", i);
+      CHECK ((children[i] = exec (cmd_line)) != -1,
+             "exec child %d", i);
+    }
+
+  for (i = 0; i < CHILD_CNT; i++)
+    CHECK (wait (children[i]) == 0x42, "wait for child %d", i);
+}
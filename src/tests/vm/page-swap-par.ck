@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-swap-par) begin
+(page-swap-par) exec child 0
+(page-swap-par) exec child 1
+(page-swap-par) exec child 2
+(page-swap-par) exec child 3
+(page-swap-par) wait for child 0
+(page-swap-par) wait for child 1
+(page-swap-par) wait for child 2
+(page-swap-par) wait for child 3
+(page-swap-par) end
+EOF
+
+# Swap writes must not be serialized: with four children faulting
+# at once, some transfer has to start while another is running.
+our ($test);
+my (@output) = read_text_file ("$test.output");
+my ($stats) = grep (/^Swap: /, @output);
+fail "missing \"Swap:\" statistics line\n" if !defined $stats;
+my ($in_flight) = $stats =~ /at most (\d+) transfers in flight/;
+fail "no transfer count in \"$stats\"\n" if !defined $in_flight;
+fail "swap transfers never overlapped\n" if $in_flight < 2;
+pass;
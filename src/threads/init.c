@@ -39,7 +39,11 @@
 #endif
 #ifdef VM
 #include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/share.h"
 #include "vm/swap.h"
+#include "vm/vma.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -132,6 +136,10 @@ main (void)
 #endif
 
 #ifdef VM
+  page_init ();
+  vma_init ();
+  mmap_init ();
+  share_init ();
   frame_init ();
   swap_init ();
 #endif
@@ -259,12 +267,22 @@ parse_options (char **argv)
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
+      else if (!strcmp (name, "-fault-around"))
+        fault_around_pages = value != NULL ? atoi (value) : 0;
+      else if (!strcmp (name, "-vm-policy"))
+        {
+          if (value == NULL || !frame_set_policy (value))
+            PANIC ("unknown page replacement policy `%s'",
+                   value != NULL ? value : "");
+        }
 #endif
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
 #ifndef USERPROG
       /* Project #3. */
       else if (!strcmp (name, "-aging"))
@@ -389,10 +407,15 @@ usage (void)
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -fault-around=N    Map up to N file pages around a fault\n"
+          "                     (default 8, 1 or less disables).\n"
+          "  -vm-policy=NAME    Evict pages with NAME: clock (default),\n"
+          "                     clock2 (two-handed clock) or wsclock.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -tickless          Stop the timer tick while idle.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -2,13 +2,14 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,14 +24,59 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, pages are handed out by a buddy allocator.
+   Free memory is kept as blocks of 2**K pages, for K less than
+   ORDER_CNT, on one free list per order K.  A block of order K
+   starts at a page index that is a multiple of 2**K, and its
+   "buddy" is the block of the same order that it would merge
+   with, at that index XOR 2**K.  Allocating CNT pages takes a
+   block of the smallest order that fits, splitting a bigger
+   block if needed, and gives the pages past CNT back.  Freeing
+   merges a block with its buddy for as long as the buddy is
+   free too.  Both take O(log n) steps.
+
+   The free lists are threaded through the free pages
+   themselves.  They are protected by disabling interrupts
+   rather than by a lock, because thread_schedule_tail() frees
+   the page of a dying thread with interrupts already off.
+
+   Each pool also keeps a few pages that the idle thread has
+   zeroed ahead of time (see palloc_zero_ahead()), so that
+   single-page PAL_ZERO requests do not have to clear 4 kB on
+   the spot.  Other requests fall back on them only when the
+   free lists are empty. */
+
+/* Number of block orders.  The largest block is 2**(ORDER_CNT -
+   1) pages. */
+#define ORDER_CNT 20
+
+/* Marks a page that does not start a free block. */
+#define NOT_FREE 0xff
+
+/* Most pre-zeroed pages a pool keeps. */
+#define ZEROED_MAX 32
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
+    const char *name;                   /* Name, for statistics. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
+    uint8_t *orders;                    /* Order of free block at page. */
+    struct list free_lists[ORDER_CNT];  /* Free blocks, by order. */
+    size_t free_cnt;                    /* Number of free pages. */
+    size_t zeroed[ZEROED_MAX];          /* Indexes of pre-zeroed pages. */
+    size_t zeroed_cnt;                  /* Number of pre-zeroed pages. */
+    size_t zeroed_max;                  /* Most pre-zeroed pages to keep. */
     uint8_t *base;                      /* Base of pool. */
+
+    /* Statistics. */
+    unsigned long long alloc_cnt;       /* Allocations. */
+    unsigned long long split_cnt;       /* Blocks split. */
+    unsigned long long merge_cnt;       /* Blocks merged. */
+    unsigned long long zero_hit_cnt;    /* PAL_ZERO pages served pre-zeroed. */
+    unsigned long long zero_miss_cnt;   /* PAL_ZERO pages zeroed on demand. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +85,12 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t get_pages (struct pool *, size_t page_cnt, bool zero,
+                         bool *zeroed);
+static bool zero_ahead (struct pool *);
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void print_pool_stats (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -73,13 +125,15 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
   size_t page_idx;
+  bool zeroed;
+  enum intr_level old_level;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  old_level = intr_disable ();
+  page_idx = get_pages (pool, page_cnt, flags & PAL_ZERO, &zeroed);
+  intr_set_level (old_level);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -88,7 +142,7 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 
   if (pages != NULL) 
     {
-      if (flags & PAL_ZERO)
+      if ((flags & PAL_ZERO) && !zeroed)
         memset (pages, 0, PGSIZE * page_cnt);
     }
   else 
@@ -119,6 +173,7 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
   size_t page_idx;
+  enum intr_level old_level;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -137,8 +192,9 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  old_level = intr_disable ();
+  buddy_free (pool, page_idx, page_cnt);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,15 +204,62 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_page_cnt (void)
+{
+  return bitmap_size (user_pool.used_map);
+}
+
+/* Returns the index of PAGE within the user pool, a number less
+   than palloc_user_page_cnt().  PAGE must be a page in the user
+   pool. */
+size_t
+palloc_user_page_idx (void *page)
+{
+  ASSERT (pg_ofs (page) == 0);
+  ASSERT (page_from_pool (&user_pool, page));
+
+  return pg_no (page) - pg_no (user_pool.base);
+}
+
+/* Returns the number of free pages in the user pool. */
+size_t
+palloc_user_free_cnt (void)
+{
+  return user_pool.free_cnt + user_pool.zeroed_cnt;
+}
+
+/* Zeroes one free page, if a pool is short of pre-zeroed pages,
+   and keeps it for a later PAL_ZERO request.  Returns true if a
+   page was zeroed, false if there was nothing to do.  Meant to
+   be called over and over by the idle thread: it never blocks,
+   and clears the page with interrupts on. */
+bool
+palloc_zero_ahead (void)
+{
+  return zero_ahead (&kernel_pool) || zero_ahead (&user_pool);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  print_pool_stats (&kernel_pool);
+  print_pool_stats (&user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's used_map and orders at its base.
+     Calculate the space needed for them and subtract it from
+     the pool's size. */
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t bm_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  size_t order;
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
@@ -164,9 +267,21 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  p->name = name;
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->orders = (uint8_t *) base + bm_size;
+  memset (p->orders, NOT_FREE, page_cnt);
+  for (order = 0; order < ORDER_CNT; order++)
+    list_init (&p->free_lists[order]);
+  p->free_cnt = 0;
+  p->zeroed_cnt = 0;
+  p->zeroed_max = page_cnt / 16 < ZEROED_MAX ? page_cnt / 16 : ZEROED_MAX;
   p->base = base + bm_pages * PGSIZE;
+
+  /* Mark every page used, then free them all at once, which
+     carves the pool into the largest blocks that fit. */
+  bitmap_set_all (p->used_map, true);
+  buddy_free (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -180,3 +295,227 @@ page_from_pool (const struct pool *pool, void *page)
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the free list element stored in POOL's page IDX. */
+static struct list_elem *
+page_elem (const struct pool *pool, size_t idx)
+{
+  return (struct list_elem *) (pool->base + idx * PGSIZE);
+}
+
+/* Returns the index of the page that holds free list element E
+   in POOL. */
+static size_t
+elem_page (const struct pool *pool, struct list_elem *e)
+{
+  return ((uint8_t *) e - pool->base) / PGSIZE;
+}
+
+/* Adds the free block of 2**ORDER pages at IDX to POOL. */
+static void
+push_block (struct pool *pool, size_t idx, size_t order)
+{
+  pool->orders[idx] = order;
+  list_push_front (&pool->free_lists[order], page_elem (pool, idx));
+}
+
+/* Removes the free block at IDX from POOL's free lists. */
+static void
+remove_block (struct pool *pool, size_t idx)
+{
+  pool->orders[idx] = NOT_FREE;
+  list_remove (page_elem (pool, idx));
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first, or BITMAP_ERROR if there are none.  A
+   single page that ZERO says must be zeroed comes from the
+   pre-zeroed pages if there are any; otherwise those are used
+   only when the free lists cannot supply the request.  Sets
+   *ZEROED to true if the pages are already zeroed.  Interrupts
+   must be off. */
+static size_t
+get_pages (struct pool *pool, size_t page_cnt, bool zero, bool *zeroed)
+{
+  size_t page_idx = BITMAP_ERROR;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  *zeroed = false;
+  if (page_cnt == 1 && pool->zeroed_cnt > 0 && zero)
+    *zeroed = true;
+  else
+    {
+      page_idx = buddy_alloc (pool, page_cnt);
+      if (page_idx == BITMAP_ERROR && page_cnt == 1 && pool->zeroed_cnt > 0)
+        *zeroed = true;
+    }
+  if (*zeroed)
+    {
+      page_idx = pool->zeroed[--pool->zeroed_cnt];
+      pool->alloc_cnt++;
+    }
+
+  if (zero && page_cnt == 1 && page_idx != BITMAP_ERROR)
+    {
+      if (*zeroed)
+        pool->zero_hit_cnt++;
+      else
+        pool->zero_miss_cnt++;
+    }
+  return page_idx;
+}
+
+/* Zeroes a free page of POOL and adds it to its pre-zeroed
+   pages, if it has fewer than it should.  Returns true if
+   successful, false if there was no need or no free page. */
+static bool
+zero_ahead (struct pool *pool)
+{
+  enum intr_level old_level;
+  size_t page_idx;
+
+  old_level = intr_disable ();
+  page_idx = (pool->zeroed_cnt < pool->zeroed_max
+              ? buddy_alloc (pool, 1) : BITMAP_ERROR);
+  if (page_idx != BITMAP_ERROR)
+    pool->alloc_cnt--;
+  intr_set_level (old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  /* Nobody else can reach the page, so zero it with interrupts
+     on.  Another thread may have filled the pool meanwhile, in
+     which case the page goes back. */
+  memset (pool->base + page_idx * PGSIZE, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  if (pool->zeroed_cnt < pool->zeroed_max)
+    pool->zeroed[pool->zeroed_cnt++] = page_idx;
+  else
+    buddy_free (pool, page_idx, 1);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first, or BITMAP_ERROR if there is no free block
+   big enough.  Interrupts must be off. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt)
+{
+  size_t want, order, idx;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Smallest order that holds PAGE_CNT pages. */
+  for (want = 0; want < ORDER_CNT && ((size_t) 1 << want) < page_cnt; want++)
+    continue;
+  for (order = want; order < ORDER_CNT; order++)
+    if (!list_empty (&pool->free_lists[order]))
+      break;
+  if (order >= ORDER_CNT)
+    return BITMAP_ERROR;
+
+  idx = elem_page (pool, list_front (&pool->free_lists[order]));
+  remove_block (pool, idx);
+
+  /* Split off the upper halves until the block is the wanted
+     size. */
+  while (order > want)
+    {
+      order--;
+      push_block (pool, idx + ((size_t) 1 << order), order);
+      pool->split_cnt++;
+    }
+
+  /* Return the unneeded tail of the block, if PAGE_CNT is not a
+     power of 2. */
+  pool->free_cnt -= (size_t) 1 << order;
+  bitmap_set_multiple (pool->used_map, idx, (size_t) 1 << order, true);
+  if (page_cnt < ((size_t) 1 << order))
+    buddy_free (pool, idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+
+  pool->alloc_cnt++;
+  return idx;
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX back into POOL,
+   merging them with free buddies.  Interrupts must be off, except
+   during initialization. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  size_t pool_cnt = bitmap_size (pool->used_map);
+  size_t end = page_idx + page_cnt;
+
+  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  pool->free_cnt += page_cnt;
+
+  /* Free the range as the largest aligned blocks that fit. */
+  while (page_idx < end)
+    {
+      size_t idx = page_idx;
+      size_t order = 0;
+
+      while (order + 1 < ORDER_CNT
+             && idx % ((size_t) 1 << (order + 1)) == 0
+             && idx + ((size_t) 1 << (order + 1)) <= end)
+        order++;
+      page_idx += (size_t) 1 << order;
+
+      /* Merge with the buddy while it is a free block of the
+         same order. */
+      while (order + 1 < ORDER_CNT)
+        {
+          size_t buddy = idx ^ ((size_t) 1 << order);
+          if (buddy + ((size_t) 1 << order) > pool_cnt
+              || pool->orders[buddy] != order)
+            break;
+          remove_block (pool, buddy);
+          pool->merge_cnt++;
+          if (buddy < idx)
+            idx = buddy;
+          order++;
+        }
+      push_block (pool, idx, order);
+    }
+}
+
+/* Prints the allocation counts of POOL and how fragmented its
+   free memory is: the number of free blocks of each order and
+   the share of free pages outside the largest free block. */
+static void
+print_pool_stats (struct pool *pool)
+{
+  size_t block_cnt[ORDER_CNT];
+  size_t free_cnt, zeroed_cnt, top = 0;
+  size_t order;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  free_cnt = pool->free_cnt;
+  zeroed_cnt = pool->zeroed_cnt;
+  for (order = 0; order < ORDER_CNT; order++)
+    block_cnt[order] = list_size (&pool->free_lists[order]);
+  intr_set_level (old_level);
+
+  printf ("%s: %llu allocations, %llu splits, %llu merges, "
+          "%zu of %zu pages free\n",
+          pool->name, pool->alloc_cnt, pool->split_cnt, pool->merge_cnt,
+          free_cnt, bitmap_size (pool->used_map));
+  printf ("%s: %llu pre-zeroed page hits, %llu misses, %zu pages zeroed\n",
+          pool->name, pool->zero_hit_cnt, pool->zero_miss_cnt, zeroed_cnt);
+  if (free_cnt == 0)
+    return;
+
+  for (order = 0; order < ORDER_CNT; order++)
+    if (block_cnt[order] > 0)
+      top = order;
+  printf ("%s: free blocks by order:", pool->name);
+  for (order = 0; order <= top; order++)
+    printf (" %zu", block_cnt[order]);
+  printf (", largest %zu pages, %zu%% fragmented\n", (size_t) 1 << top,
+          (free_cnt - ((size_t) 1 << top)) * 100 / free_cnt);
+}
@@ -0,0 +1,256 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Slab allocator.
+
+   Each cache hands out objects of a single size.  It gets its
+   memory a page at a time from the page allocator; each page,
+   called a "slab", starts with a header and is then packed
+   with objects, so that an object wastes only its share of the
+   header and of the slack at the end of the page, instead of
+   up to half of a power-of-2 malloc() block.
+
+   Free objects in a slab are chained through an array of
+   indexes in the slab header rather than through the objects
+   themselves.  Thus a freed object keeps its contents, and the
+   optional constructor only has to run once, when its slab is
+   created: objects must be freed in their constructed state.
+
+   A cache keeps its slabs that have free objects on a list,
+   fuller slabs first so that nearly empty slabs get a chance to
+   drain.  When a slab becomes empty, it goes back to the page
+   allocator unless it is the cache's only empty slab. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* End of a slab's free index chain. */
+#define SLAB_NONE UINT16_MAX
+
+/* Object cache. */
+struct slab_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t obj_cnt;             /* Number of objects in a slab. */
+    size_t obj_ofs;             /* Offset of first object in a slab. */
+    void (*ctor) (void *);      /* Constructor, or null. */
+    struct lock lock;           /* Lock. */
+    struct list slabs;          /* Slabs with free objects. */
+    size_t slab_cnt;            /* Number of slabs. */
+    size_t empty_cnt;           /* Number of slabs with no objects in use. */
+    size_t in_use;              /* Objects in use. */
+
+    /* Statistics. */
+    size_t peak_in_use;         /* Most objects ever in use at once. */
+    unsigned long long alloc_cnt;       /* Allocations. */
+    unsigned long long free_cnt;        /* Frees. */
+  };
+
+/* Slab header, at the start of each slab's page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct slab_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in cache's slab list. */
+    size_t in_use;              /* Objects in use. */
+    uint16_t free_idx;          /* First free object, or SLAB_NONE. */
+    uint16_t next[];            /* Next free object after each object. */
+  };
+
+/* Our set of caches. */
+static struct slab_cache caches[16];
+static size_t cache_cnt;
+
+static struct slab *slab_create (struct slab_cache *);
+static void *slab_obj (struct slab *, size_t idx);
+
+/* Creates and returns a cache for objects of OBJ_SIZE bytes,
+   which must be small enough that several fit in a page.
+   NAME is used in statistics.  If CTOR is nonnull, it is called
+   on each object once, before it is first handed out. */
+struct slab_cache *
+slab_cache_create (const char *name, size_t obj_size, void (*ctor) (void *))
+{
+  struct slab_cache *c;
+  size_t obj_cnt;
+
+  ASSERT (cache_cnt < sizeof caches / sizeof *caches);
+  ASSERT (obj_size > 0 && obj_size <= PGSIZE / 4);
+
+  c = &caches[cache_cnt++];
+  c->name = name;
+  c->obj_size = ROUND_UP (obj_size, sizeof (void *));
+  c->ctor = ctor;
+
+  /* Fit as many objects as we can after the header. */
+  for (obj_cnt = PGSIZE / c->obj_size; ; obj_cnt--)
+    {
+      size_t ofs = ROUND_UP (sizeof (struct slab)
+                             + obj_cnt * sizeof (uint16_t),
+                             sizeof (void *));
+      if (ofs + obj_cnt * c->obj_size <= PGSIZE)
+        {
+          c->obj_cnt = obj_cnt;
+          c->obj_ofs = ofs;
+          break;
+        }
+    }
+
+  lock_init (&c->lock);
+  list_init (&c->slabs);
+  c->slab_cnt = c->empty_cnt = c->in_use = c->peak_in_use = 0;
+  c->alloc_cnt = c->free_cnt = 0;
+  return c;
+}
+
+/* Obtains and returns an object from cache C, or a null pointer
+   if memory is not available. */
+void *
+slab_alloc (struct slab_cache *c)
+{
+  struct slab *s;
+  size_t idx;
+
+  ASSERT (!intr_context ());
+
+  lock_acquire (&c->lock);
+  if (list_empty (&c->slabs))
+    {
+      s = slab_create (c);
+      if (s == NULL)
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+      list_push_front (&c->slabs, &s->elem);
+    }
+  s = list_entry (list_front (&c->slabs), struct slab, elem);
+
+  idx = s->free_idx;
+  s->free_idx = s->next[idx];
+  if (s->in_use++ == 0)
+    c->empty_cnt--;
+  if (s->free_idx == SLAB_NONE)
+    list_remove (&s->elem);
+
+  c->alloc_cnt++;
+  if (++c->in_use > c->peak_in_use)
+    c->peak_in_use = c->in_use;
+  lock_release (&c->lock);
+
+  return slab_obj (s, idx);
+}
+
+/* Returns OBJ, which must have been obtained from cache C, to
+   it.  A null pointer is ignored. */
+void
+slab_free (struct slab_cache *c, void *obj)
+{
+  struct slab *s;
+  size_t idx;
+
+  if (obj == NULL)
+    return;
+
+  s = pg_round_down (obj);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+  idx = ((uint8_t *) obj - ((uint8_t *) s + c->obj_ofs)) / c->obj_size;
+  ASSERT (slab_obj (s, idx) == obj);
+
+  lock_acquire (&c->lock);
+  if (s->free_idx == SLAB_NONE)
+    list_push_front (&c->slabs, &s->elem);
+  s->next[idx] = s->free_idx;
+  s->free_idx = idx;
+  c->free_cnt++;
+  c->in_use--;
+
+  if (--s->in_use == 0)
+    {
+      if (c->empty_cnt > 0)
+        {
+          list_remove (&s->elem);
+          c->slab_cnt--;
+          s->magic = 0;
+          palloc_free_page (s);
+        }
+      else
+        {
+          /* Keep it in reserve, behind the partly used slabs. */
+          list_remove (&s->elem);
+          list_push_back (&c->slabs, &s->elem);
+          c->empty_cnt++;
+        }
+    }
+  lock_release (&c->lock);
+}
+
+/* Prints usage statistics for each cache. */
+void
+slab_print_stats (void)
+{
+  size_t i;
+
+  for (i = 0; i < cache_cnt; i++)
+    {
+      struct slab_cache *c = &caches[i];
+      size_t capacity = c->slab_cnt * c->obj_cnt;
+
+      printf ("%s cache: %zu-byte objects, %zu in use (peak %zu), "
+              "%zu slabs, %llu allocs, %llu frees, %zu%% full\n",
+              c->name, c->obj_size, c->in_use, c->peak_in_use,
+              c->slab_cnt, c->alloc_cnt, c->free_cnt,
+              capacity > 0 ? c->in_use * 100 / capacity : 0);
+    }
+}
+
+/* Gets a page for a new, empty slab in cache C, constructs its
+   objects, and returns it.  Returns a null pointer if memory is
+   not available.  C's lock must be held. */
+static struct slab *
+slab_create (struct slab_cache *c)
+{
+  struct slab *s;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->in_use = 0;
+  s->free_idx = 0;
+  for (i = 0; i < c->obj_cnt; i++)
+    {
+      s->next[i] = i + 1 < c->obj_cnt ? i + 1 : SLAB_NONE;
+      if (c->ctor != NULL)
+        c->ctor (slab_obj (s, i));
+    }
+
+  c->slab_cnt++;
+  c->empty_cnt++;
+  return s;
+}
+
+/* Returns object IDX in slab S. */
+static void *
+slab_obj (struct slab *s, size_t idx)
+{
+  struct slab_cache *c = s->cache;
+
+  ASSERT (idx < c->obj_cnt);
+  return (uint8_t *) s + c->obj_ofs + idx * c->obj_size;
+}
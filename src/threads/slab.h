@@ -0,0 +1,15 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* Object cache for fixed-size kernel objects. */
+struct slab_cache;
+
+struct slab_cache *slab_cache_create (const char *name, size_t obj_size,
+                                      void (*ctor) (void *));
+void *slab_alloc (struct slab_cache *);
+void slab_free (struct slab_cache *, void *);
+void slab_print_stats (void);
+
+#endif /* threads/slab.h */
@@ -19,14 +19,33 @@ static int load_avg;
 #define LOAD_AVG_NUMERATOR 59
 #define LOAD_AVG_DENOMINATOR 60
 
+/* Maximum number of lock holders that one priority donation is
+   passed along, so that a cycle of waiters cannot loop
+   forever. */
+#define DONATION_DEPTH 8
+
+/* MLFQS recent_cpu의 초당 감쇠는 실행 중인 스레드와 ready 스레드에만 바로
+   적용한다. block된 스레드는 깨어날 때 놓친 감쇠를 한꺼번에 적용한다.
+   decay_epoch는 지금까지의 감쇠 횟수이고, 각 감쇠에 쓴 계수
+   (2*load_avg)/(2*load_avg+1)를 decay_coefs에 최근 DECAY_HISTORY개만큼
+   남겨 둔다. 그보다 오래 잔 스레드는 남아 있는 가장 오래된 계수로 대신한다. */
+#define DECAY_HISTORY 64
+static int64_t decay_epoch;
+static int decay_coefs[DECAY_HISTORY];
+
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, with one FIFO queue per
+   priority.  Bit P of ready_mask is set iff ready_queues[P] is
+   nonempty, so that the highest ready priority is a single
+   find-last-set away and no queue ever has to be sorted. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_mask;
+static int ready_cnt;           /* Number of ready threads. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -57,6 +76,8 @@ static long long user_ticks;    /* # of timer ticks in user programs. */
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+static long long donation_cnt;  /* # of priority donations. */
+static int donation_max_depth;  /* Longest chain a donation went along. */
 
 #ifndef USERPROG
 /* Project #3. */
@@ -73,6 +94,10 @@ static void kernel_thread (thread_func *, void *aux);
 static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
+static int ready_max_priority (void);
+static void ready_remove (struct thread *);
+static void set_ready_priority (struct thread *, int priority);
+static void refresh_priority (struct thread *);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
@@ -83,9 +108,10 @@ static tid_t allocate_tid (void);
 static int get_ready_threads (void);
 static void calculate_recent_cpu (struct thread *);
 static void update_recent_cpu (void);
+static int mlfqs_priority (struct thread *);
 static void calculate_priority (struct thread *);
 static void update_priorities (void);
-static void update_load_avg (void);
+static void update_load_avg (int ready_threads);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -103,12 +129,17 @@ static void update_load_avg (void);
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   load_avg = 0;
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
+  ready_mask = 0;
+  ready_cnt = 0;
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -135,13 +166,13 @@ thread_start (void)
   sema_down (&idle_started);
 }
 
-/* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
-void
-thread_tick (void) 
+/* Charges one timer tick to T, the thread that ran during it,
+   and does the MLFQS load average and recent_cpu bookkeeping due
+   at that tick.  READY_THREADS is the number of threads that were
+   running or ready to run at the time. */
+static void
+account_tick (struct thread *t, int ready_threads)
 {
-  struct thread *t = thread_current ();
-
   /* Update statistics. */
   if (t == idle_thread)
     idle_ticks++;
@@ -157,13 +188,21 @@ thread_tick (void)
       t->recent_cpu = ADD_MIX(t->recent_cpu, 1);
 
     if (timer_ticks () % TIMER_FREQ == 0) {
-      update_load_avg ();
+      update_load_avg (ready_threads);
       update_recent_cpu ();
     }
-
-    if (timer_ticks () % 4 == 0)
-      update_priorities ();
   }
+}
+
+/* Called by the timer interrupt handler at each timer tick.
+   Thus, this function runs in an external interrupt context. */
+void
+thread_tick (void) 
+{
+  account_tick (thread_current (), get_ready_threads ());
+
+  if (thread_mlfqs && timer_ticks () % 4 == 0)
+    update_priorities ();
 
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
@@ -176,12 +215,28 @@ thread_tick (void)
   #endif
 }
 
+/* Called by the timer interrupt handler, in place of
+   thread_tick(), for each tick that went by without an interrupt
+   while the timer was in tickless mode.  Tickless mode is only
+   entered from the idle thread with nothing ready, and any
+   wakeup ends it at the next tick, so the idle thread was
+   running alone during every such tick, whichever thread is
+   running now. */
+void
+thread_tick_idle (void)
+{
+  account_tick (idle_thread, 0);
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
 {
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  if (donation_cnt > 0)
+    printf ("Thread: %lld priority donations, up to %d holders deep\n",
+            donation_cnt, donation_max_depth);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -262,6 +317,11 @@ thread_block (void)
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
+  /* Fix the priority the MLFQS would give this thread at the next
+     4-tick update; it does not change again until the thread
+     misses a recent_cpu decay. */
+  if (thread_mlfqs)
+    calculate_priority (thread_current ());
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
 }
@@ -283,8 +343,11 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
+  if (thread_mlfqs)
+    thread_mlfqs_update (t);
   thread_insert_ready_list(t);
   t->status = THREAD_READY;
+  timer_tickless_exit ();
   intr_set_level (old_level);
 }
 
@@ -354,7 +417,14 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    thread_insert_ready_list(cur);
+    {
+      /* Under MLFQS, requeue at the priority that the recent_cpu
+         charged since the last 4-tick update gives, as preemption
+         at the end of a time slice also comes through here. */
+      if (thread_mlfqs)
+        cur->priority = mlfqs_priority (cur);
+      thread_insert_ready_list(cur);
+    }
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -381,17 +451,15 @@ thread_foreach (thread_action_func *func, void *aux)
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
-
   enum intr_level old_level = intr_disable ();
 
+  // 기부받은 우선순위가 더 높으면 그대로 유지된다.
+  thread_current ()->base_priority = new_priority;
+  refresh_priority (thread_current ());
+
   // 더 높은 우선순위의 스레드가 있다면 양보
-  if (!list_empty(&ready_list)) {
-    struct thread* highest_ready = list_entry(list_front(&ready_list), struct thread, elem);
-    
-    if (highest_ready->priority > new_priority)
-      thread_yield ();
-  }
+  if (ready_max_priority () > thread_current ()->priority)
+    thread_yield ();
 
   intr_set_level (old_level);
 }
@@ -414,12 +482,8 @@ thread_set_nice (int nice)
 
   calculate_priority (current);
   
-  if (!list_empty (&ready_list))
-  {
-    struct thread *highest_thread = list_entry (list_front (&ready_list), struct thread, elem);
-    if (highest_thread->priority > current->priority)
-      thread_yield ();
-  }
+  if (ready_max_priority () > current->priority)
+    thread_yield ();
   
   intr_set_level (old_level);
 }
@@ -437,71 +501,129 @@ thread_get_nice (void)
 static int
 get_ready_threads (void)
 {
-  int ready_threads = list_size (&ready_list);
+  int ready_threads = ready_cnt;
   if (thread_current () != idle_thread)
     ready_threads++;
   return ready_threads;
 }
 
 static void
-update_load_avg (void)
+update_load_avg (int ready_threads)
 {
-  int ready_threads = get_ready_threads();
   load_avg = DIV_FP(MULT_FP(INT_TO_FP(LOAD_AVG_NUMERATOR), load_avg) + INT_TO_FP(ready_threads), INT_TO_FP(LOAD_AVG_DENOMINATOR));
 }
 
+/* t가 놓친 recent_cpu 감쇠를 적용한다. */
 static void
 calculate_recent_cpu (struct thread *t)
 {
-  if (t != idle_thread) {
-    int load_avg2 = MULT_FP(load_avg, INT_TO_FP(2));
-    int coef = DIV_FP(load_avg2, ADD_FP(load_avg2, INT_TO_FP(1)));
-    int weighted_cpu = MULT_FP(coef, t->recent_cpu);
-    t->recent_cpu = ADD_FP(weighted_cpu, INT_TO_FP(t->nice));
+  int64_t oldest = decay_epoch - DECAY_HISTORY + 1;
+  int64_t epoch;
+
+  if (t == idle_thread)
+    return;
+
+  epoch = t->recent_cpu_epoch + 1;
+
+  // 기록이 남아 있지 않은 감쇠는 가장 오래된 계수로 대신한다. 같은 계수를
+  // 거듭 적용하면 고정점에 수렴하므로, 오래 잔 스레드라도 DECAY_HISTORY번까지만
+  // 적용하고 값이 더 변하지 않으면 그만둔다.
+  if (epoch < oldest) {
+    int coef = decay_coefs[oldest % DECAY_HISTORY];
+    int64_t i;
+
+    for (i = 0; i < DECAY_HISTORY && epoch + i < oldest; i++) {
+      int prev = t->recent_cpu;
+      t->recent_cpu = ADD_FP(MULT_FP(coef, t->recent_cpu), INT_TO_FP(t->nice));
+      if (t->recent_cpu == prev)
+        break;
+    }
+    epoch = oldest;
   }
+
+  for (; epoch <= decay_epoch; epoch++) {
+    int coef = decay_coefs[epoch % DECAY_HISTORY];
+    t->recent_cpu = ADD_FP(MULT_FP(coef, t->recent_cpu), INT_TO_FP(t->nice));
+  }
+  t->recent_cpu_epoch = decay_epoch;
 }
 
+/* 1초마다 호출된다. 새 감쇠 계수를 기록하고 실행 중인 스레드와 ready
+   스레드의 recent_cpu, 우선순위를 갱신한다. block된 스레드는 건드리지 않는다. */
 static void
 update_recent_cpu (void)
 {
-  struct list_elem *e;
-  for (e = list_begin (&all_list); e != list_end (&all_list); e = list_next (e)) {
-    struct thread *t = list_entry (e, struct thread, allelem);
+  struct list ready;
+  int load_avg2 = MULT_FP(load_avg, INT_TO_FP(2));
+  int p;
+
+  decay_epoch++;
+  decay_coefs[decay_epoch % DECAY_HISTORY] = DIV_FP(load_avg2, ADD_FP(load_avg2, INT_TO_FP(1)));
+
+  calculate_recent_cpu (thread_current ());
+
+  // 높은 큐부터 꺼내 같은 우선순위 안의 순서를 유지한 채 다시 넣는다.
+  list_init (&ready);
+  for (p = PRI_MAX; p >= PRI_MIN; p--)
+    list_splice (list_end (&ready), list_begin (&ready_queues[p]),
+                 list_end (&ready_queues[p]));
+  ready_mask = 0;
+  ready_cnt = 0;
+  while (!list_empty (&ready)) {
+    struct thread *t = list_entry (list_pop_front (&ready), struct thread, elem);
     calculate_recent_cpu (t);
+    t->priority = mlfqs_priority (t);
+    thread_insert_ready_list (t);
   }
 }
 
+/* recent_cpu와 nice로 계산한 t의 MLFQS 우선순위를 돌려준다. */
+static int
+mlfqs_priority (struct thread *t)
+{
+  int recent_cpu_term = FP_TO_INT(DIV_MIX(t->recent_cpu, 4));
+  int new_priority = PRI_MAX - recent_cpu_term - (t->nice * 2);
+
+  if (new_priority < PRI_MIN) new_priority = PRI_MIN;
+  if (new_priority > PRI_MAX) new_priority = PRI_MAX;
+  return new_priority;
+}
+
 static void
 calculate_priority (struct thread *t)
 {
-  if (t != idle_thread) {
-    int recent_cpu_term = FP_TO_INT(DIV_MIX(t->recent_cpu, 4));
-    int new_priority = PRI_MAX - recent_cpu_term - (t->nice * 2);
-    
-    if (new_priority < PRI_MIN) new_priority = PRI_MIN;
-    if (new_priority > PRI_MAX) new_priority = PRI_MAX;
-      
-    t->priority = new_priority;
-  }
+  if (t != idle_thread)
+    set_ready_priority (t, mlfqs_priority (t));
 }
 
+/* 4 tick마다 호출된다. 그 사이 recent_cpu가 바뀐 스레드는 실행 중인
+   스레드뿐이고 ready 스레드는 update_recent_cpu()에서 갱신되므로, 실행
+   중인 스레드의 우선순위만 다시 계산한다. */
 static void
 update_priorities (void)
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  
-  struct list_elem *e;
-  for (e = list_begin (&all_list); e != list_end (&all_list); e = list_next (e)) {
-    struct thread *t = list_entry (e, struct thread, allelem);
-    calculate_priority (t);
-  }
 
-  if (!list_empty (&ready_list)) {
-    struct thread *cur = thread_current ();
-    struct thread *highest_ready = list_entry (list_front (&ready_list), struct thread, elem);
-    if (highest_ready->priority > cur->priority)
-      intr_yield_on_return ();
+  calculate_priority (thread_current ());
+
+  if (ready_max_priority () > thread_current ()->priority)
+    intr_yield_on_return ();
+}
+
+/* Brings the MLFQS recent_cpu and priority of blocked thread T up
+   to date, for when T is about to be woken or chosen among the
+   waiters on a semaphore. */
+void
+thread_mlfqs_update (struct thread *t)
+{
+  enum intr_level old_level = intr_disable ();
+
+  ASSERT (thread_mlfqs);
+  if (t->recent_cpu_epoch != decay_epoch) {
+    calculate_recent_cpu (t);
+    calculate_priority (t);
   }
+  intr_set_level (old_level);
 }
 
 /* Returns 100 times the system load average. */
@@ -542,6 +664,11 @@ idle (void *idle_started_ UNUSED)
 
   for (;;) 
     {
+      /* Zero free pages ahead of PAL_ZERO requests while nobody
+         else wants the CPU. */
+      while (ready_mask == 0 && palloc_zero_ahead ())
+        continue;
+
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
@@ -610,11 +737,16 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
+  t->base_priority = priority;
+  list_init (&t->donations);
   t->magic = THREAD_MAGIC;
 
 #ifdef VM
   t->spt.buckets = NULL;
+  lock_init(&t->spt_lock);
+  vma_table_init(&t->vmas);
   list_init(&t->mmap_list);
+  list_init(&t->frame_list);
   t->next_mapid = 0;
 #endif
   
@@ -625,6 +757,7 @@ init_thread (struct thread *t, const char *name, int priority)
     t->nice = thread_current()->nice;
     t->recent_cpu = thread_current()->recent_cpu;
   }
+  t->recent_cpu_epoch = decay_epoch;
 
   old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
@@ -666,10 +799,152 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  struct thread *t;
+
+  if (ready_mask == 0)
     return idle_thread;
+  t = list_entry (list_front (&ready_queues[ready_max_priority ()]),
+                  struct thread, elem);
+  ready_remove (t);
+  return t;
+}
+
+/* Returns the priority of the highest-priority ready thread, or
+   -1 if no thread is ready.  Interrupts must be off. */
+static int
+ready_max_priority (void)
+{
+  uint32_t high = ready_mask >> 32;
+
+  /* The mask is split in halves so that the compiler can use bsr
+     instead of calling a 64-bit helper. */
+  if (high != 0)
+    return 63 - __builtin_clz (high);
+  else if ((uint32_t) ready_mask != 0)
+    return 31 - __builtin_clz ((uint32_t) ready_mask);
+  else
+    return -1;
+}
+
+/* Removes ready thread T from its run queue. */
+static void
+ready_remove (struct thread *t)
+{
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_mask &= ~((uint64_t) 1 << t->priority);
+  ready_cnt--;
+}
+
+/* Sets T's priority to PRIORITY, moving T to the matching run
+   queue if it is ready.  Interrupts must be off. */
+static void
+set_ready_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->status == THREAD_READY && t->priority != priority)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      thread_insert_ready_list (t);
+    }
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    t->priority = priority;
+}
+
+/* Recomputes T's priority as the highest of its base priority
+   and the priorities of the threads donating to it.  Interrupts
+   must be off. */
+static void
+refresh_priority (struct thread *t)
+{
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&t->donations); e != list_end (&t->donations);
+       e = list_next (e))
+    {
+      struct thread *donor = list_entry (e, struct thread, donation_elem);
+      if (donor->priority > priority)
+        priority = donor->priority;
+    }
+  set_ready_priority (t, priority);
+}
+
+/* Makes the current thread a donor to the holder of LOCK, which
+   it is about to wait for, and passes its priority along the
+   chain of holders that are themselves waiting for locks, up to
+   DONATION_DEPTH holders deep.  Interrupts must be off. */
+void
+thread_donate_priority (struct lock *lock)
+{
+  struct thread *t = thread_current ();
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (lock->holder != NULL);
+
+  t->wait_on_lock = lock;
+  list_push_back (&lock->holder->donations, &t->donation_elem);
+
+  for (depth = 0; depth < DONATION_DEPTH && t->wait_on_lock != NULL; depth++)
+    {
+      struct thread *holder = t->wait_on_lock->holder;
+
+      if (holder == NULL || holder->priority >= t->priority)
+        break;
+      set_ready_priority (holder, t->priority);
+      t = holder;
+    }
+  donation_cnt++;
+  if (depth > donation_max_depth)
+    donation_max_depth = depth;
+}
+
+/* Called by the current thread once it holds LOCK.  The threads
+   still waiting for LOCK become its donors, including any that
+   started waiting while LOCK had no holder to donate to. */
+void
+thread_lock_acquired (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+  struct list *waiters = &lock->semaphore.waiters;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  cur->wait_on_lock = NULL;
+  for (e = list_begin (waiters); e != list_end (waiters); e = list_next (e))
+    {
+      struct thread *donor = list_entry (e, struct thread, elem);
+      donor->wait_on_lock = lock;
+      list_push_back (&cur->donations, &donor->donation_elem);
+    }
+  refresh_priority (cur);
+}
+
+/* Called by the current thread when it is about to release LOCK.
+   Drops the donations from the threads waiting for LOCK. */
+void
+thread_lock_released (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&cur->donations); e != list_end (&cur->donations); )
+    {
+      struct thread *donor = list_entry (e, struct thread, donation_elem);
+      if (donor->wait_on_lock == lock)
+        e = list_remove (e);
+      else
+        e = list_next (e);
+    }
+  refresh_priority (cur);
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -701,6 +976,11 @@ thread_schedule_tail (struct thread *prev)
   /* Start new time slice. */
   thread_ticks = 0;
 
+  /* While the idle thread runs with nothing ready, no tick is
+     needed until the next timer event. */
+  if (cur == idle_thread && ready_mask == 0)
+    timer_tickless_enter ();
+
 #ifdef USERPROG
   /* Activate the new address space. */
   process_activate ();
@@ -790,21 +1070,35 @@ thread_priority_compare (const struct list_elem *a, const struct list_elem *b, v
   return ta->priority > tb->priority;
 }
 
-/* ready_list에 스레드 우선순위가 높은 순서로 삽입 */
+/* 우선순위에 해당하는 run queue의 맨 뒤에 삽입 (O(1)) */
 void
 thread_insert_ready_list (struct thread *t)
 {
-  list_insert_ordered(&ready_list, &t->elem, thread_priority_compare, NULL);
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_mask |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
 }
 
+/* ready 스레드의 우선순위를 1씩 올린다. 큐를 정렬하지 않고 높은 큐부터
+   한 칸 위 큐의 뒤로 통째로 옮긴다. PRI_MAX 큐는 그대로 둔다. */
 void thread_aging (void)
 {
-  struct list_elem *e = list_begin (&ready_list);
-  while (e != list_end (&ready_list)) {
-    struct thread *t = list_entry (e, struct thread, elem);
-    if (t->priority < PRI_MAX) {
+  uint64_t top = (uint64_t) 1 << PRI_MAX;
+  int p;
+
+  for (p = PRI_MAX - 1; p >= PRI_MIN; p--) {
+    struct list *q = &ready_queues[p];
+    struct list_elem *e;
+
+    if (list_empty (q))
+      continue;
+    for (e = list_begin (q); e != list_end (q); e = list_next (e)) {
+      struct thread *t = list_entry (e, struct thread, elem);
       t->priority++;
+      if (t->base_priority < PRI_MAX)
+        t->base_priority++;
     }
-    e = list_next (e);
+    list_splice (list_end (&ready_queues[p + 1]), list_begin (q), list_end (q));
   }
+  ready_mask = (ready_mask << 1) | (ready_mask & top);
 }
@@ -7,6 +7,7 @@
 #include <stdint.h>
 #include "threads/synch.h" /* Project #3. */
 #include "vm/page.h"
+#include "vm/vma.h"
 
 #define F (1 << 14)
 #define INT_TO_FP(n) ((n) * F)
@@ -108,19 +109,26 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Priority, with donations. */
+    int base_priority;                  /* Priority without donations. */
     struct list_elem allelem;           /* List element for all threads list. */
  
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
+    struct lock *wait_on_lock;          /* Lock being waited for. */
+    struct list donations;              /* Threads donating priority. */
+    struct list_elem donation_elem;     /* Element in `donations'. */
     
-    int64_t wake_up_time;
     int nice;
     int recent_cpu;
+    int64_t recent_cpu_epoch;           /* Decays applied to recent_cpu. */
 #ifdef VM
     struct hash spt;
+    struct lock spt_lock;               /* Guards spt's buckets. */
+    struct vma_table vmas;              /* Regions the SPT is built from. */
     struct list mmap_list;
     mapid_t next_mapid;
+    struct list frame_list;             /* Frames this thread owns. */
 #endif    
 
 #ifdef USERPROG
@@ -138,7 +146,7 @@ struct thread
     bool is_waited; // 이미 wait 되었는지 표시
 
     struct file *fd_table[128]; // 파일 디스크립터 테이블
-    int next_fd; // 다음 할당될 fd 번호
+    int next_fd; // 지금까지 쓴 가장 큰 fd + 1
     struct file *exec_file; // 실행 중인 파일
 #endif
 
@@ -155,6 +163,7 @@ void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_tick_idle (void);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -186,5 +195,9 @@ struct thread* get_child_thread(tid_t tid);
 bool thread_priority_compare (const struct list_elem *a, const struct list_elem *b, void *aux UNUSED);
 void thread_insert_ready_list (struct thread *t);
 void thread_aging (void);
+void thread_mlfqs_update (struct thread *);
+void thread_donate_priority (struct lock *);
+void thread_lock_acquired (struct lock *);
+void thread_lock_released (struct lock *);
 
 #endif /* threads/thread.h */
@@ -14,6 +14,7 @@
 #include "userprog/pagedir.h"
 #include "vm/swap.h"
 #include "vm/stack.h"
+#include "vm/share.h"
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -21,6 +22,7 @@ static long long page_fault_cnt;
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 static bool handle_mm_fault (struct page_table_entry *pte, bool write);
+static bool handle_cow_fault (struct page_table_entry *pte);
 
 /* Registers handlers for interrupts that can be caused by user
    programs.
@@ -166,7 +168,7 @@ page_fault (struct intr_frame *f)
     
     if (not_present) {
       // Not-present 페이지 폴트
-      struct page_table_entry *pte = spt_find(&t->spt, fault_page);
+      struct page_table_entry *pte = spt_get_page(t, fault_page);
 
       if (pte != NULL) {
         // 이미 매핑된 페이지: demand paging
@@ -181,8 +183,13 @@ page_fault (struct intr_frame *f)
           }
         }
       } 
-    } else {
-     
+    } else if (write) {
+      // fork() 후 함께 쓰는 페이지에 처음 쓰기
+      struct page_table_entry *pte = spt_find(&t->spt, fault_page);
+
+      if (pte != NULL && pte->cow && handle_cow_fault(pte)) {
+        return;
+      }
     }
   }
   
@@ -210,10 +217,39 @@ handle_mm_fault (struct page_table_entry *pte, bool write)
   }
   
   if (pte->is_loaded) {
+    // 스왑에서 미리 읽어 둔 페이지: 매핑만 하면 된다
+    if (pte->readahead) {
+      if (!pagedir_set_page(thread_current()->pagedir, pte->upage,
+                            pte->kpage, pte->writable)) {
+        return false;
+      }
+      pte->readahead = false;
+      swap_count_readahead_hit();
+    }
     return true;
   }
   
-  void *frame = get_frame(PAL_USER, pte->upage);
+  // 쓰기 불가능한 코드 페이지는 같은 파일을 실행하는 프로세스와 함께 쓴다
+  if (share_is_shareable(pte)) {
+    return share_map(pte);
+  }
+
+  // mmap한 파일 페이지는 그 파일을 매핑한 프로세스들과 한 프레임을 쓴다
+  if (pte->type == PAGE_MMAP) {
+    if (!share_map_file(pte, false)) {
+      return false;
+    }
+    page_fault_around(pte);
+    return true;
+  }
+
+  // 스택과 bss처럼 전부 0인 페이지는 미리 0으로 채워 둔 프레임으로 받는다
+  bool zero_fill = pte->type == PAGE_STACK
+                   || (pte->type == PAGE_BINARY && pte->read_bytes == 0);
+  // 파일에서 읽는 페이지면 주변 페이지도 함께 읽는다 (fault-around)
+  bool from_file = pte->type == PAGE_BINARY && !zero_fill;
+  void *frame = get_frame(zero_fill ? PAL_USER | PAL_ZERO : PAL_USER,
+                          pte->upage);
   if (frame == NULL) {
     return false;
   }
@@ -221,6 +257,9 @@ handle_mm_fault (struct page_table_entry *pte, bool write)
   bool success = true;
   switch (pte->type) {
     case PAGE_BINARY:
+      if (zero_fill) {
+        break;
+      }
       file_seek(pte->file, pte->file_offset);
       int bytes_read = file_read(pte->file, frame, pte->read_bytes);
       if (bytes_read != (int)pte->read_bytes) {
@@ -235,23 +274,10 @@ handle_mm_fault (struct page_table_entry *pte, bool write)
         success = false;
         break;
       }    
-      swap_in(pte->swap_slot, frame);
-      pte->swap_slot = 0;
-      pte->type = pte->original_type;
+      page_swap_in(pte, frame);
       break;
       
     case PAGE_STACK:
-      memset(frame, 0, PGSIZE);
-      break;
-      
-    case PAGE_MMAP:
-      file_seek(pte->file, pte->file_offset);
-      bytes_read = file_read(pte->file, frame, pte->read_bytes);
-      if (bytes_read != (int)pte->read_bytes) {
-        success = false;
-      } else {
-        memset(frame + pte->read_bytes, 0, pte->zero_bytes);
-      }
       break;
       
     default:
@@ -271,6 +297,33 @@ handle_mm_fault (struct page_table_entry *pte, bool write)
   
   pte->kpage = frame;
   pte->is_loaded = true;
+  pte->readahead = false;
+  frame_unpin(frame);
+
+  if (from_file) {
+    page_fault_around(pte);
+  }
   
+  return true;
+}
+
+/* 읽기 전용으로 매핑된 COW 페이지 PTE를 private 프레임으로 바꿔 쓰기
+   가능하게 다시 매핑한다. */
+static bool
+handle_cow_fault (struct page_table_entry *pte)
+{
+  uint32_t *pd = thread_current()->pagedir;
+  void *frame = frame_cow_break(pte);
+
+  // 그 사이에 스왑으로 쫓겨났으면 다시 폴트나서 private 페이지로 읽힌다
+  if (frame == NULL) {
+    return !pte->cow;
+  }
+
+  pagedir_clear_page(pd, pte->upage);
+  if (!pagedir_set_page(pd, pte->upage, frame, true)) {
+    return false;
+  }
+  frame_unpin(frame);
   return true;
 }
\ No newline at end of file
@@ -20,10 +20,16 @@
 #include "userprog/syscall.h"
 #include "vm/page.h"
 #include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/stack.h"
+#include "vm/vma.h"
 #include "threads/malloc.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static bool fork_process (struct thread *parent);
+static tid_t wait_for_load (tid_t tid);
 
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
@@ -54,6 +60,32 @@ process_execute (const char *file_name)
     return TID_ERROR;
   }
 
+  return wait_for_load (tid);
+}
+
+/* Starts a new thread running a copy of the current process,
+   which entered the kernel with interrupt frame F.  The copy
+   returns 0 from the system call.  Returns the new process's
+   thread id, or TID_ERROR if the process cannot be copied. */
+tid_t
+process_fork (struct intr_frame *f)
+{
+  tid_t tid;
+
+  /* F stays valid because we wait for the child to copy it. */
+  tid = thread_create (thread_name (), PRI_DEFAULT, start_fork, f);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+
+  return wait_for_load (tid);
+}
+
+/* Waits for new child TID to finish loading or copying its
+   address space.  Returns TID if it succeeded, TID_ERROR
+   otherwise. */
+static tid_t
+wait_for_load (tid_t tid)
+{
   struct thread *child = get_child_thread(tid);
   if(child == NULL) {
     return TID_ERROR;
@@ -113,6 +145,74 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+/* A thread function that copies its parent's process, which is
+   waiting in process_fork(), and starts it running. */
+static void
+start_fork (void *parent_if_)
+{
+  struct intr_frame if_;
+  struct thread *cur = thread_current ();
+  bool success;
+
+  memcpy (&if_, parent_if_, sizeof if_);
+  if_.eax = 0;
+
+#ifdef VM
+  spt_init (&cur->spt);
+#endif
+  success = fork_process (cur->parent);
+
+  cur->load_success = success;
+  sema_up (&cur->load_sema);
+
+  if (!success)
+    {
+      cur->exit_status = -1;
+      thread_exit ();
+    }
+
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Copies PARENT's address space and open files into the current
+   thread.  Private pages are shared copy-on-write rather than
+   copied.  On failure, process_exit() frees whatever was copied
+   so far. */
+static bool
+fork_process (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  int fd;
+
+  cur->pagedir = pagedir_create ();
+  if (cur->pagedir == NULL)
+    return false;
+  process_activate ();
+
+#ifdef VM
+  if (!vma_fork (&cur->vmas, &parent->vmas)
+      || !spt_fork (parent) || !mmap_fork (parent))
+    return false;
+#endif
+
+  if (parent->exec_file != NULL)
+    {
+      cur->exec_file = file_duplicate (parent->exec_file);
+      if (cur->exec_file == NULL)
+        return false;
+    }
+  for (fd = 2; fd < parent->next_fd; fd++)
+    if (parent->fd_table[fd] != NULL)
+      {
+        cur->fd_table[fd] = file_duplicate (parent->fd_table[fd]);
+        if (cur->fd_table[fd] == NULL)
+          return false;
+      }
+  cur->next_fd = parent->next_fd;
+  return true;
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -151,8 +251,6 @@ process_exit (void)
   // exit status 출력
   printf("%s: exit(%d)\n", cur->name, cur->exit_status);
  
-  lock_acquire(&filesys_lock);
-
   for (int fd = 2; fd < 128; fd++) {
     if (cur->fd_table[fd] != NULL) {
       file_close(cur->fd_table[fd]);
@@ -165,8 +263,6 @@ process_exit (void)
     file_close(cur->exec_file);
     cur->exec_file = NULL;
   }
-
-  lock_release(&filesys_lock);
   
   #ifdef VM
     // MMAP 정리 (파일 write back 및 파일 닫기)
@@ -177,6 +273,9 @@ process_exit (void)
     
     // SPT 정리 (메타데이터만 정리, frame은 이미 해제됨)
     spt_destroy(&cur->spt);
+
+    // 영역 정리 (PTE가 빌려 쓰던 파일 닫기)
+    vma_destroy(&cur->vmas);
   #endif
 
   // 부모가 wait 중이면 깨워줌
@@ -337,10 +436,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
   char *program_name = argv[0];
   
   /* Open executable file. */
-  lock_acquire(&filesys_lock);
-
   file = filesys_open (program_name);
-  lock_release(&filesys_lock);
   
   if (file == NULL) 
     {
@@ -490,9 +586,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
   if (!success) {
     if (file != NULL) {
-      lock_acquire(&filesys_lock);
       file_close (file);
-      lock_release(&filesys_lock);
       t->exec_file = NULL;
     }
   }
@@ -501,8 +595,6 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
-static bool install_page (void *upage, void *kpage, bool writable);
-
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
 static bool
@@ -570,94 +662,33 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  while (read_bytes > 0 || zero_bytes > 0) 
+  /* Record the segment as one region.  Its pages are set up
+     from the region when they are first touched. */
+  struct file *seg_file = NULL;
+  if (read_bytes > 0)
     {
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-      struct page_table_entry *pte = malloc(sizeof(struct page_table_entry));
-      if (pte == NULL)
-        return false;
-      
-      memset(pte, 0, sizeof(*pte));
-      pte->upage = upage;
-      pte->kpage = NULL;
-      pte->is_loaded = false;
-      pte->type = PAGE_BINARY;
-      pte->original_type = PAGE_BINARY;
-
-      lock_acquire(&filesys_lock);
-      pte->file = file_reopen(file);
-      lock_release(&filesys_lock);
-      if (pte->file == NULL) {
-        free(pte);
-        return false;
-      }
-
-      pte->file_offset = ofs;
-      pte->read_bytes = page_read_bytes;
-      pte->zero_bytes = page_zero_bytes;
-      pte->writable = writable;
-
-      pte->swap_slot = 0; 
-
-      if (!spt_insert(&thread_current()->spt, pte)) {
-        lock_acquire(&filesys_lock);
-        file_close(pte->file);
-        lock_release(&filesys_lock);
-        free(pte);
+      seg_file = file_reopen (file);
+      if (seg_file == NULL)
         return false;
-      }
-
-      /* Advance. */
-      read_bytes -= page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      upage += PGSIZE;
-      ofs += page_read_bytes;
+    }
+  if (vma_create (&thread_current ()->vmas, upage, read_bytes + zero_bytes,
+                  seg_file, ofs, read_bytes, writable) == NULL)
+    {
+      if (seg_file != NULL)
+        file_close (seg_file);
+      return false;
     }
   return true;
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+   user virtual memory.  The page is an ordinary stack page, so
+   it can be evicted and copied by fork() like the rest. */
 static bool
 setup_stack (void **esp) 
 {
-  uint8_t *kpage;
-  bool success = false;
-
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL) 
-    {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = PHYS_BASE;
-      else
-        palloc_free_page (kpage);
-    }
-
-  return success;
-}
-
-/* Adds a mapping from user virtual address UPAGE to kernel
-   virtual address KPAGE to the page table.
-   If WRITABLE is true, the user process may modify the page;
-   otherwise, it is read-only.
-   UPAGE must not already be mapped.
-   KPAGE should probably be a page obtained from the user pool
-   with palloc_get_page().
-   Returns true on success, false if UPAGE is already mapped or
-   if memory allocation fails. */
-static bool
-install_page (void *upage, void *kpage, bool writable)
-{
-  struct thread *t = thread_current ();
-
-  /* Verify that there's not already a page at that virtual
-     address, then map our page there. */
-  return (pagedir_get_page (t->pagedir, upage) == NULL
-          && pagedir_set_page (t->pagedir, upage, kpage, writable));
+  if (!grow_stack (((uint8_t *) PHYS_BASE) - PGSIZE))
+    return false;
+  *esp = PHYS_BASE;
+  return true;
 }
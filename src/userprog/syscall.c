@@ -15,6 +15,8 @@
 #include "vm/page.h"
 #include "vm/stack.h"
 #include "vm/mmap.h"
+#include "vm/vma.h"
+#include "vm/share.h"
 
 static void syscall_handler (struct intr_frame *);
 static int allocate_fd (struct file *file);
@@ -26,12 +28,9 @@ static struct file *get_file (int fd);
 #define STDIN 0
 #define STDOUT 1
 
-struct lock filesys_lock;
-
 void
 syscall_init (void) 
 {
-  lock_init(&filesys_lock);
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
@@ -52,23 +51,32 @@ check_valid_uaddr (const void *uaddr)
     return;
   }
 
-  // SPT에 있는 페이지
+  // SPT에 있거나 영역 안에 있는 페이지
   struct page_table_entry *pte = spt_find(&t->spt, page);
-  if (pte != NULL) {
+  if (pte != NULL || vma_find(&t->vmas, page) != NULL) {
     return;
   }
 
   exit (-1);
 }
 
+// 닫혀서 비어 있는 가장 작은 fd를 다시 쓴다
 static int allocate_fd (struct file *file) {
   struct thread *t = thread_current();
-  if(t->next_fd >= FD_MAX) {
+  int fd;
+
+  for (fd = FD_MIN; fd < FD_MAX; fd++) {
+    if (t->fd_table[fd] == NULL) {
+      break;
+    }
+  }
+  if (fd >= FD_MAX) {
     return -1;
   }
-  int fd = t->next_fd;
   t->fd_table[fd] = file;
-  t->next_fd++;
+  if (fd >= t->next_fd) {
+    t->next_fd = fd + 1;
+  }
   return fd;
 }
 
@@ -91,8 +99,8 @@ static void preload_buffer_write(void *buffer, unsigned size) {
        upage <= pg_round_down(buffer + size - 1); 
        upage += PGSIZE) {
     
-    // SPT 확인
-    struct page_table_entry *pte = spt_find(&t->spt, upage);
+    // SPT 확인 (영역 안이면 PTE를 만든다)
+    struct page_table_entry *pte = spt_get_page(t, upage);
     
     // writable이 아니면 exit
     if (pte != NULL && !pte->writable) {
@@ -171,6 +179,10 @@ syscall_handler (struct intr_frame *f UNUSED)
       f->eax = fibonacci(*(esp + 1));
       break;
 
+    case SYS_FORK:
+      f->eax = sys_fork (f);
+      break;
+
     case SYS_MAX_OF_FOUR_INT:
       check_valid_uaddr (esp + 1);
       check_valid_uaddr (esp + 2);
@@ -249,6 +261,10 @@ tid_t exec(const char *cmd_line) {
   return process_execute(cmd_line);
 }
 
+tid_t sys_fork(struct intr_frame *f) {
+  return process_fork(f);
+}
+
 int wait(tid_t tid) {
   return process_wait(tid);
 }
@@ -268,9 +284,7 @@ int read (int fd, void *buffer, unsigned size) {
     }
     preload_buffer_write(buffer, size);
 
-    lock_acquire(&filesys_lock);
     int result = file_read (f, buffer, size);
-    lock_release(&filesys_lock);
     return result;
   }
   return -1;
@@ -289,9 +303,7 @@ int write (int fd, const void *buffer, unsigned size) {
       exit(-1);
     }
 
-    lock_acquire(&filesys_lock);
     int result = file_write (f, buffer, size);
-    lock_release(&filesys_lock);
     return result;
   }
   return -1;
@@ -317,28 +329,30 @@ int max_of_four_int (int a, int b, int c, int d) {
 }
 
 bool create (const char *file, unsigned initial_size) {
-  lock_acquire(&filesys_lock);
   bool result = filesys_create (file, initial_size);
-  lock_release(&filesys_lock);
   return result;
 }
 
 bool remove (const char *file) {
-  lock_acquire(&filesys_lock);
   bool result = filesys_remove (file);
-  lock_release(&filesys_lock);
+
+  // 캐시에 남은 코드 페이지가 지운 실행 파일을 열어 두지 않게 한다
+  if (result) {
+    share_forget_removed ();
+  }
   return result;
 }
 
 int open (const char *file) {
-  lock_acquire(&filesys_lock);
   struct file *f = filesys_open (file);
-  lock_release(&filesys_lock);
 
   if (f == NULL) {
     return -1;
   }
   int fd = allocate_fd (f);
+  if (fd == -1) {
+    file_close (f);
+  }
   return fd;
 }
 
@@ -347,9 +361,7 @@ void close (int fd) {
   if (f == NULL) {
     exit(-1);
   }
-  lock_acquire(&filesys_lock);
   file_close (f);
-  lock_release(&filesys_lock);
   thread_current()->fd_table[fd] = NULL;
 }
 
@@ -358,9 +370,7 @@ int filesize (int fd) {
   if (f == NULL) {
     exit(-1);
   }
-  lock_acquire(&filesys_lock);
   int result = file_length (f);
-  lock_release(&filesys_lock);
   return result;
 }
 
@@ -369,9 +379,7 @@ void seek (int fd, unsigned position) {
   if (f == NULL) {
     exit(-1);
   }
-  lock_acquire(&filesys_lock);
   file_seek (f, position);
-  lock_release(&filesys_lock);
 }
 
 unsigned tell (int fd) {
@@ -379,9 +387,7 @@ unsigned tell (int fd) {
   if (f == NULL) {
     exit(-1);
   }
-  lock_acquire(&filesys_lock);
   unsigned result = file_tell (f);
-  lock_release(&filesys_lock);
   return result;
 }
 
@@ -395,9 +401,7 @@ mapid_t sys_mmap(int fd, void *addr) {
     return -1;
   }
 
-  lock_acquire(&filesys_lock);
   off_t file_len = file_length(file);
-  lock_release(&filesys_lock);
   if (file_len == 0) {
     return -1;
   }
@@ -406,9 +410,7 @@ mapid_t sys_mmap(int fd, void *addr) {
       return -1;
   }
 
-  lock_acquire(&filesys_lock);
   struct file *reopened_file = file_reopen(file);
-  lock_release(&filesys_lock);
   if (reopened_file == NULL) {
     return -1;
   }
@@ -1,12 +1,10 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "vm/mmap.h"
 
-// 전역 파일 시스템 락
-extern struct lock filesys_lock;
-
 void syscall_init (void);
 
 void check_valid_uaddr (const void *uaddr);
@@ -14,6 +12,7 @@ void check_valid_uaddr (const void *uaddr);
 void halt (void);
 void exit (int status);
 tid_t exec (const char *cmd_line);
+tid_t sys_fork (struct intr_frame *f);
 int wait (tid_t pid);
 int read (int fd, void *buffer, unsigned size);
 int write (int fd, const void *buffer, unsigned size);
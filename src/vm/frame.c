@@ -3,33 +3,229 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/synch.h"
 #include "threads/palloc.h"
 #include "threads/malloc.h"
+#include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "vm/page.h"
 #include "vm/swap.h"
+#include "vm/share.h"
 #include "filesys/file.h"
+#include "filesys/inode.h"
 #include "userprog/syscall.h"
 
-static struct list frame_table;
-static struct list_elem *clock_hand;
+/* 유저 풀의 프레임 번호로 인덱싱되는 프레임 테이블.
+   frame_table[i]는 유저 풀의 i번째 페이지를 나타낸다. */
+static struct frame_table_entry *frame_table;
+static size_t frame_cnt;
+static size_t clock_hand;
 static struct lock frame_lock;
 
+/* 교체 정책. select()는 frame_lock을 잡은 채 호출되며, 쫓아낼
+   프레임을 고르거나 모두 고정되어 있으면 NULL을 반환한다.
+   카운터는 부팅 때 고른 정책 하나에만 쌓인다. */
+struct frame_policy {
+  const char *name;
+  struct frame_table_entry *(*select)(void);
+
+  unsigned long long alloc_cnt;   /* get_frame() 호출 수 */
+  unsigned long long evict_cnt;   /* 쫓아낸 프레임 수 */
+  unsigned long long write_cnt;   /* 스왑/파일에 써야 했던 수 */
+  unsigned long long scan_cnt;    /* 시계 바늘이 지나간 엔트리 수 */
+};
+
+static struct frame_table_entry *clock_select(void);
+static struct frame_table_entry *two_hand_select(void);
+static struct frame_table_entry *wsclock_select(void);
+
+static struct frame_policy policies[] = {
+  {"clock", clock_select, 0, 0, 0, 0},
+  {"clock2", two_hand_select, 0, 0, 0, 0},
+  {"wsclock", wsclock_select, 0, 0, 0, 0},
+};
+#define POLICY_CNT (sizeof policies / sizeof *policies)
+
+static struct frame_policy *policy = &policies[0];
+
+/* Page cleaner. 빈 프레임이 LOW_WATER 아래로 내려가면 깨어나서,
+   최근에 접근되지 않은 dirty 프레임을 스왑/파일에 미리 써 두고 깨끗해진
+   프레임을 HIGH_WATER까지 풀어 준다. 그래서 폴트 경로의 eviction은
+   보통 쓰기 없이 끝난다. 스왑에 미리 쓴 사본의 슬롯은 페이지가 메모리에
+   있는 동안에도 pte->swap_slot에 남는다. */
+#define CLEANER_BATCH 16        /* 한 번에 미리 쓸 최대 페이지 수 */
+static size_t low_water;
+static size_t high_water;
+static size_t cleaner_hand;
+static bool cleaner_running;
+static struct semaphore cleaner_sema;
+
+static unsigned long long cleaned_cnt;  /* 미리 쓴 페이지 수 */
+static unsigned long long reclaim_cnt;  /* cleaner가 풀어 준 프레임 수 */
+
+/* Copy-on-write. fork()한 부모와 자식은 쓰기 가능한 private 페이지의
+   프레임을 읽기 전용으로 함께 매핑한다. 함께 쓰는 프레임은 소유자 대신
+   그 프레임을 가리키는 PTE들의 목록(map_ptes)을 가지며, 쫓겨날 때는
+   스왑에 한 번 쓰고 모든 PTE가 그 슬롯을 함께 가리킨다. 쓰기 폴트가
+   나면 frame_cow_break()가 사본을 만들고, 혼자 남은 프로세스는 복사하지
+   않고 프레임을 가져간다. */
+static unsigned long long cow_share_cnt;  /* fork에서 함께 쓰게 된 페이지 수 */
+static unsigned long long cow_copy_cnt;   /* 쓰기 폴트에서 복사한 수 */
+static unsigned long long cow_reuse_cnt;  /* 복사 없이 가져간 수 */
+
+/* 파일 페이지 캐시 (share.c). mmap한 파일 페이지와 쓰기 불가능한 코드
+   페이지의 프레임은 그 파일을 매핑한 모든 프로세스가 함께 쓴다. COW
+   프레임처럼 소유자 대신 매핑한 PTE들의 목록을 가지며, mmap 페이지는
+   매핑을 없앨 때마다 그 매핑의 dirty 비트를 프레임의 dirty에 모은다.
+   파일에는 쫓겨날 때나 마지막 PTE가 놓을 때 한 번만 쓰고, 코드 페이지는
+   쓰지 않고 버린다. 파일 페이지의 kpage는 frame_lock이 지킨다.
+
+   파일에 쓰는 동안에는 프레임을 고정하고 frame_lock을 놓는다. inode의
+   락을 frame_lock 아래에서 잡지 않기 위해서이고, 그동안 다른 스레드도
+   eviction을 할 수 있다. 쓰는 사이에 다시 매핑되거나 바뀐 프레임은
+   쫓아내지 않는다. 고정된 파일 페이지 프레임을 놓거나 고정하려는 쪽은
+   io_cond에서 쓰기가 끝나기를 기다린다. */
+
+/* 스왑 I/O. 스왑에 쓰는 동안에도 프레임을 고정하고(io) frame_lock을
+   놓으므로 여러 스레드의 쓰기가 함께 진행된다. private 페이지는 쓰는
+   동안에도 소유자에게 매핑된 채로 두고 dirty 비트만 먼저 지운다. 다 쓴
+   뒤 frame_unmap_if_clean()이 그 사이에 바뀌지 않았을 때만 매핑을
+   없애고, 바뀌었으면 쫓아내기를 포기한다. io인 프레임의 주인을 바꾸거나
+   놓으려는 쪽(fork, COW, 프로세스 종료)은 io_cond에서 기다린다. */
+static struct condition io_cond;
+
+/* Fault-around. 폴트 난 페이지 옆의 파일 페이지를 미리 읽어 매핑한
+   프레임은 prefetched로 표시해 두고, 접근 비트가 켜진 것을 처음 보면
+   쓰인 것으로, 그 전에 프레임을 놓으면 버린 것으로 센다. 접근 비트는
+   pagedir_clear_page() 뒤에도 남으므로 frame_release()에서 볼 수 있다. */
+static unsigned long long prefetch_cnt;       /* 미리 매핑한 페이지 수 */
+static unsigned long long prefetch_used_cnt;  /* 그 중 접근된 수 */
+static unsigned long long prefetch_waste_cnt; /* 접근되기 전에 놓인 수 */
+
+static thread_func page_cleaner NO_RETURN;
+static bool frame_is_stale(struct frame_table_entry *fte);
+static bool frame_needs_write(struct frame_table_entry *fte);
+static void frame_io_wait(struct frame_table_entry *fte);
+
 static void *evict_page(void);
 static void *handle_eviction(struct frame_table_entry *victim);
-static void cleanup_invalid_frames(void);
-static void update_clock_hand_if_needed(struct list_elem *removed_elem);
+static void frame_release(struct frame_table_entry *fte);
+static void frame_settle_prefetch(struct frame_table_entry *fte, bool final);
+static bool frame_is_private(struct frame_table_entry *fte);
 
 void frame_init (void) {
-  list_init(&frame_table);
-  clock_hand = NULL;
+  frame_cnt = palloc_user_page_cnt();
+  frame_table = calloc(frame_cnt, sizeof *frame_table);
+  if (frame_table == NULL && frame_cnt > 0)
+    PANIC("frame_init: cannot allocate frame table");
+  clock_hand = 0;
   lock_init(&frame_lock);
+  cond_init(&io_cond);
+
+  low_water = frame_cnt / 32;
+  high_water = frame_cnt / 16;
+  cleaner_hand = 0;
+  cleaner_running = false;
+  sema_init(&cleaner_sema, 0);
+  thread_create("page-cleaner", PRI_DEFAULT, page_cleaner, NULL);
 }
 
-void *get_frame (enum palloc_flags flags, void *upage) {
+// -vm-policy=NAME 옵션. frame_init() 전에 불린다.
+bool frame_set_policy(const char *name) {
+  size_t i;
+
+  for (i = 0; i < POLICY_CNT; i++) {
+    if (!strcmp(name, policies[i].name)) {
+      policy = &policies[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+void frame_print_stats(void) {
+  printf("Frames: %s policy, %llu allocations, %llu evictions "
+         "(%llu written back), %llu entries scanned\n",
+         policy->name, policy->alloc_cnt, policy->evict_cnt,
+         policy->write_cnt, policy->scan_cnt);
+  printf("Page cleaner: %llu pages cleaned, %llu frames reclaimed\n",
+         cleaned_cnt, reclaim_cnt);
+  printf("Copy-on-write: %llu pages shared, %llu copied, %llu reused\n",
+         cow_share_cnt, cow_copy_cnt, cow_reuse_cnt);
+  printf("Fault-around: %llu pages prefetched, %llu used, %llu wasted\n",
+         prefetch_cnt, prefetch_used_cnt, prefetch_waste_cnt);
+}
+
+// 커널 가상 주소 FRAME에 해당하는 엔트리 (O(1))
+static struct frame_table_entry *frame_lookup(void *frame) {
+  return &frame_table[palloc_user_page_idx(frame)];
+}
+
+/* FTE를 다른 스레드가 frame_lock 밖에서 스왑에 쓰고 있으면 끝날 때까지
+   기다린다. 기다리는 동안 frame_lock을 놓으므로 돌아온 뒤에는 상태를
+   다시 봐야 한다. frame_lock을 잡고 호출. */
+static void frame_io_wait(struct frame_table_entry *fte) {
+  while (fte->io) {
+    cond_wait(&io_cond, &frame_lock);
+  }
+}
+
+// FTE들을 고정하고 I/O 중으로 표시한다. frame_lock을 잡고 호출.
+static void frame_io_begin(struct frame_table_entry *ftes[], size_t cnt) {
+  size_t i;
+
+  for (i = 0; i < cnt; i++) {
+    ASSERT(!ftes[i]->io);
+    ftes[i]->pinned = true;
+    ftes[i]->io = true;
+  }
+}
+
+// frame_io_begin()을 되돌리고 기다리는 스레드를 깨운다
+static void frame_io_end(struct frame_table_entry *ftes[], size_t cnt) {
+  size_t i;
+
+  for (i = 0; i < cnt; i++) {
+    ftes[i]->pinned = false;
+    ftes[i]->io = false;
+  }
+  cond_broadcast(&io_cond, &frame_lock);
+}
+
+/* 스왑에 쓰는 동안 PD의 UPAGE가 바뀌지 않았으면 매핑을 없애고 true.
+   단일 프로세서에서 dirty 비트를 본 뒤 매핑을 없애기 전에 소유자가 쓰지
+   못하도록 그 사이에만 인터럽트를 끈다. */
+static bool frame_unmap_if_clean(uint32_t *pd, void *upage) {
+  enum intr_level old_level = intr_disable();
+  bool clean = !pagedir_is_dirty(pd, upage);
+
+  if (clean) {
+    pagedir_clear_page(pd, upage);
+  }
+  intr_set_level(old_level);
+  return clean;
+}
+
+/* 프레임을 할당해 현재 스레드의 UPAGE 프레임으로 등록한다. 빈 프레임이
+   없으면 EVICT가 true일 때만 다른 페이지를 쫓아낸다. 반환된 프레임은
+   고정되어 있어서 내용을 채우는 동안 쫓겨나지 않으며, 매핑이 끝나면
+   frame_unpin()을 불러야 한다. */
+static void *frame_alloc (enum palloc_flags flags, void *upage, bool evict) {
+  struct frame_table_entry *fte;
+  struct thread *cur = thread_current();
   void *frame = palloc_get_page(PAL_USER | flags);
+  if (frame == NULL) {
+    if (!evict) {
+      return NULL;
+    }
+    // 아무도 매핑하지 않은 공유 코드 페이지는 쓰기 없이 바로 버릴 수 있다
+    while (frame == NULL && share_reclaim()) {
+      frame = palloc_get_page(PAL_USER | flags);
+    }
+  }
   if (frame == NULL) {
     lock_acquire(&frame_lock); 
     frame = evict_page();
@@ -37,111 +233,836 @@ void *get_frame (enum palloc_flags flags, void *upage) {
     if (frame == NULL) {
       return NULL;
     }
+    // 쫓아낸 프레임에는 이전 내용이 남아 있음
+    if (flags & PAL_ZERO)
+      memset(frame, 0, PGSIZE);
   }
 
-  struct frame_table_entry *fte = malloc(sizeof(struct frame_table_entry));
-  if (fte == NULL) {
-    palloc_free_page(frame);
+  lock_acquire(&frame_lock);
+  policy->alloc_cnt++;
+  fte = frame_lookup(frame);
+  ASSERT(!fte->in_use);
+  fte->frame = frame;
+  fte->upage = upage;
+  fte->owner = cur;
+  fte->pinned = true;
+  fte->in_use = true;
+  fte->prefetched = false;
+  fte->io = false;
+  fte->file_page = NULL;
+  list_push_back(&cur->frame_list, &fte->elem);
+
+  if (!cleaner_running && palloc_user_free_cnt() < low_water) {
+    cleaner_running = true;
+    sema_up(&cleaner_sema);
+  }
+  lock_release(&frame_lock);
+
+  return frame;
+}
+
+void *get_frame (enum palloc_flags flags, void *upage) {
+  return frame_alloc(flags, upage, true);
+}
+
+// 빈 프레임이 있을 때만 할당한다 (readahead용)
+void *try_get_frame (void *upage) {
+  return frame_alloc(PAL_USER, upage, false);
+}
+
+/* fault-around용. 빈 프레임이 page cleaner가 맞추려는 HIGH_WATER보다
+   많을 때만 할당한다. 미리 읽느라 다른 페이지를 쫓아내게 하지 않는다. */
+void *frame_get_prefetch (void *upage) {
+  if (palloc_user_free_cnt() <= high_water) {
     return NULL;
   }
+  return frame_alloc(PAL_USER, upage, false);
+}
 
-  fte->frame = frame;
-  fte->upage = upage;
-  fte->owner = thread_current();
+/* frame_get_prefetch()로 받아 내용을 채우고 매핑한 FRAME의 고정을 풀고,
+   접근되는지 지켜보도록 표시한다. */
+void frame_set_prefetched (void *frame) {
+  struct frame_table_entry *fte;
+
+  lock_acquire(&frame_lock);
+  fte = frame_lookup(frame);
+  ASSERT(fte->in_use);
   fte->pinned = false;
+  fte->prefetched = true;
+  prefetch_cnt++;
+  lock_release(&frame_lock);
+}
+
+// get_frame()으로 받은 프레임의 고정을 푼다
+void frame_unpin (void *frame) {
+  struct frame_table_entry *fte;
 
   lock_acquire(&frame_lock);
-  list_push_back(&frame_table, &fte->elem);
+  fte = frame_lookup(frame);
+  if (fte->in_use) {
+    fte->pinned = false;
+  }
   lock_release(&frame_lock);
+}
+
+/* fork() 중인 자식(현재 스레드)의 CPTE를 부모 PARENT의 PPTE와 같은
+   내용으로 채운다. PPTE는 메모리에 있으면 쓰기 가능한 private 페이지만
+   COW로 함께 쓰고, 스왑에 있으면 슬롯을 함께 쓴다. 나머지는 자식이
+   처음 접근할 때 파일이나 공유 코드 페이지에서 다시 읽는다. 부모는
+   자식이 끝낼 때까지 기다리지만 다른 스레드의 eviction이 PPTE를 바꿀
+   수 있으므로 CPTE의 type과 original_type도 frame_lock 아래에서 PPTE를
+   보고 정한다. */
+bool frame_cow_share(struct thread *parent, struct page_table_entry *ppte,
+                     struct page_table_entry *cpte) {
+  struct frame_table_entry *fte;
+  bool success = true;
 
+  lock_acquire(&frame_lock);
+  // 다른 스레드가 쫓아내느라 쓰는 중이면 끝난 뒤의 PPTE를 본다
+  while (ppte->is_loaded && ppte->kpage != NULL
+         && frame_lookup(ppte->kpage)->io) {
+    cond_wait(&io_cond, &frame_lock);
+  }
+  // spt_fork()가 복사한 뒤에 PPTE가 쫓겨나 스왑으로 갔을 수 있다
+  cpte->type = ppte->type;
+  cpte->original_type = ppte->original_type;
+  if (!ppte->is_loaded || ppte->kpage == NULL) {
+    if (ppte->type == PAGE_SWAP) {
+      swap_share(ppte->swap_slot);
+      cpte->swap_slot = ppte->swap_slot;
+    }
+  } else if (ppte->readahead) {
+    // 매핑 전인 미리 읽은 페이지는 스왑 사본을 갖고 있다
+    swap_share(ppte->swap_slot);
+    cpte->swap_slot = ppte->swap_slot;
+    cpte->original_type = ppte->type;
+    cpte->type = PAGE_SWAP;
+  } else if (ppte->writable && ppte->shared == NULL) {
+    fte = frame_lookup(ppte->kpage);
+    if (!ppte->cow) {
+      ASSERT(fte->map_cnt == 0 && fte->owner == parent);
+      // 부모가 바꾼 내용이면 page cleaner가 써 둔 사본은 낡았다
+      if (ppte->swap_slot != 0
+          && pagedir_is_dirty(parent->pagedir, ppte->upage)) {
+        swap_free(ppte->swap_slot);
+        ppte->swap_slot = 0;
+      }
+      frame_settle_prefetch(fte, true);
+      list_remove(&fte->elem);
+      fte->owner = NULL;
+      fte->upage = NULL;
+      list_init(&fte->map_ptes);
+      pagedir_clear_page(parent->pagedir, ppte->upage);
+      pagedir_set_page(parent->pagedir, ppte->upage, ppte->kpage, false);
+      ppte->cow = true;
+      ppte->map_thread = parent;
+      list_push_back(&fte->map_ptes, &ppte->map_elem);
+      fte->map_cnt = 1;
+    }
+    cpte->kpage = ppte->kpage;
+    cpte->is_loaded = true;
+    cpte->cow = true;
+    cpte->map_thread = thread_current();
+    list_push_back(&fte->map_ptes, &cpte->map_elem);
+    fte->map_cnt++;
+    cow_share_cnt++;
+
+    success = pagedir_set_page(cpte->map_thread->pagedir, cpte->upage,
+                               cpte->kpage, false);
+  }
+  lock_release(&frame_lock);
+  return success;
+}
+
+/* PTE를 COW 프레임 FTE의 목록에서 뺀다. 마지막이었으면 프레임을
+   테이블에서 빼고 true를 반환한다. frame_lock을 잡고 호출. */
+static bool frame_cow_put(struct frame_table_entry *fte,
+                          struct page_table_entry *pte) {
+  ASSERT(fte->in_use && fte->map_cnt > 0);
+  list_remove(&pte->map_elem);
+  pte->cow = false;
+  if (--fte->map_cnt > 0) {
+    return false;
+  }
+  frame_release(fte);
+  return true;
+}
+
+/* 혼자 남은 PTE가 COW 프레임 FTE를 현재 스레드의 private 프레임으로
+   가져간다. 다시 매핑할 때까지 고정해 둔다. frame_lock을 잡고 호출. */
+static void frame_cow_claim(struct frame_table_entry *fte,
+                            struct page_table_entry *pte) {
+  struct thread *cur = thread_current();
+
+  ASSERT(fte->map_cnt == 1);
+  list_remove(&pte->map_elem);
+  pte->cow = false;
+  fte->map_cnt = 0;
+  fte->owner = cur;
+  fte->upage = pte->upage;
+  fte->pinned = true;
+  list_push_back(&cur->frame_list, &fte->elem);
+  cow_reuse_cnt++;
+}
+
+/* 현재 스레드의 COW 페이지 PTE에 쓰기 폴트가 났다. 함께 쓰는 프로세스가
+   남아 있으면 새 프레임에 복사하고, 아니면 프레임을 그대로 가져가서
+   PTE가 그 private 프레임을 가리키게 하고 반환한다. 반환된 프레임은
+   고정되어 있으므로 매핑한 뒤 frame_unpin()을 불러야 한다. 메모리가
+   없거나, 그 사이에 쫓겨나 PTE가 더 이상 COW가 아니면 NULL. */
+void *frame_cow_break(struct page_table_entry *pte) {
+  struct frame_table_entry *fte;
+  void *copy;
+
+  lock_acquire(&frame_lock);
+  if (pte->cow) {
+    frame_io_wait(frame_lookup(pte->kpage));
+  }
+  if (!pte->cow) {
+    lock_release(&frame_lock);
+    return NULL;
+  }
+  fte = frame_lookup(pte->kpage);
+  if (fte->map_cnt == 1) {
+    frame_cow_claim(fte, pte);
+    lock_release(&frame_lock);
+    return pte->kpage;
+  }
+  lock_release(&frame_lock);
+
+  copy = get_frame(PAL_USER, pte->upage);
+  if (copy == NULL) {
+    return NULL;
+  }
+
+  // 프레임을 구하는 동안 COW 프레임이 쫓겨났거나 혼자 남았을 수 있다
+  lock_acquire(&frame_lock);
+  if (pte->cow) {
+    frame_io_wait(frame_lookup(pte->kpage));
+  }
+  if (!pte->cow) {
+    lock_release(&frame_lock);
+    free_frame(copy);
+    return NULL;
+  }
+  fte = frame_lookup(pte->kpage);
+  if (fte->map_cnt == 1) {
+    frame_cow_claim(fte, pte);
+    lock_release(&frame_lock);
+    free_frame(copy);
+    return pte->kpage;
+  }
+  memcpy(copy, pte->kpage, PGSIZE);
+  frame_cow_put(fte, pte);
+  pte->kpage = copy;
+  cow_copy_cnt++;
+  lock_release(&frame_lock);
+  return copy;
+}
+
+/* 현재 스레드가 COW 페이지 PTE를 더 이상 쓰지 않는다. 그 사이에 쫓겨나
+   스왑으로 갔으면 아무 일도 하지 않는다. */
+void frame_cow_unref(struct page_table_entry *pte) {
+  void *frame = NULL;
+
+  lock_acquire(&frame_lock);
+  if (pte->cow) {
+    frame_io_wait(frame_lookup(pte->kpage));
+  }
+  if (pte->cow && frame_cow_put(frame_lookup(pte->kpage), pte)) {
+    frame = pte->kpage;
+  }
+  lock_release(&frame_lock);
+
+  if (frame != NULL) {
+    palloc_free_page(frame);
+  }
+}
+
+/* 현재 스레드의 PTE를 파일 페이지 프레임 FTE에 매핑한다.
+   frame_lock을 잡고 호출. */
+static bool frame_file_add(struct frame_table_entry *fte,
+                           struct page_table_entry *pte) {
+  struct thread *cur = thread_current();
+
+  if (!pagedir_set_page(cur->pagedir, pte->upage, fte->frame,
+                        pte->writable)) {
+    return false;
+  }
+  pte->kpage = fte->frame;
+  pte->is_loaded = true;
+  pte->map_thread = cur;
+  list_push_back(&fte->map_ptes, &pte->map_elem);
+  fte->map_cnt++;
+  return true;
+}
+
+/* PTE의 매핑을 파일 페이지 프레임 FTE에서 없애고 mmap 페이지면 dirty
+   비트를 프레임에 모은다. frame_lock을 잡고 호출. */
+static void frame_file_remove(struct frame_table_entry *fte,
+                              struct page_table_entry *pte) {
+  uint32_t *pd = pte->map_thread->pagedir;
+
+  if (fte->file_page->mmap && pagedir_is_dirty(pd, pte->upage)) {
+    fte->dirty = true;
+  }
+  pagedir_clear_page(pd, pte->upage);
+  list_remove(&pte->map_elem);
+  fte->map_cnt--;
+  pte->kpage = NULL;
+  pte->is_loaded = false;
+}
+
+/* 매핑이 없는 파일 페이지 프레임 FTE가 바뀌었으면 고정하고 frame_lock을
+   놓은 채 파일에 쓴다. 쓰는 동안 다시 매핑되었거나 바뀌었으면 false.
+   frame_lock을 잡고 호출하며, 반환할 때도 잡고 있다. */
+static bool frame_file_writeback(struct frame_table_entry *fte) {
+  struct shared_page *sp = fte->file_page;
+
+  ASSERT(fte->map_cnt == 0 && !fte->pinned);
+  if (!fte->dirty) {
+    return true;
+  }
+  fte->pinned = true;
+  fte->dirty = false;
+  lock_release(&frame_lock);
+
+  inode_write_at(sp->inode, fte->frame, sp->read_bytes, sp->offset);
+
+  lock_acquire(&frame_lock);
+  fte->pinned = false;
+  cond_broadcast(&io_cond, &frame_lock);
+  return fte->map_cnt == 0 && !fte->dirty;
+}
+
+/* 파일 페이지 SP의 프레임이 파일에 쓰이는 중이면 끝날 때까지 기다린다.
+   frame_lock을 잡고 호출. */
+static void frame_file_wait(struct shared_page *sp) {
+  while (sp->kpage != NULL && frame_lookup(sp->kpage)->pinned) {
+    cond_wait(&io_cond, &frame_lock);
+  }
+}
+
+/* 매핑이 없고 깨끗한 파일 페이지 프레임 FTE를 파일 페이지에서 떼어
+   테이블에서 뺀다. frame_lock을 잡고 호출. */
+static void frame_file_drop(struct frame_table_entry *fte) {
+  struct shared_page *sp = fte->file_page;
+
+  ASSERT(fte->map_cnt == 0 && !fte->dirty);
+  frame_settle_prefetch(fte, true);
+  sp->kpage = NULL;
+  fte->file_page = NULL;
+  frame_release(fte);
+}
+
+/* 파일 페이지 SP가 메모리에 있으면 현재 스레드의 PTE를 그 프레임에
+   매핑하고 true를 반환한다. 매핑에 성공했는지는 PTE->is_loaded로 안다. */
+bool frame_file_map(struct shared_page *sp, struct page_table_entry *pte) {
+  bool success = false;
+
+  lock_acquire(&frame_lock);
+  if (sp->kpage != NULL) {
+    frame_file_add(frame_lookup(sp->kpage), pte);
+    success = true;
+  }
+  lock_release(&frame_lock);
+  return success;
+}
+
+/* 파일 페이지 SP가 메모리에 있으면 그 프레임을 고정해 반환한다. 다 쓰면
+   frame_unpin()을 불러야 한다. 메모리에 없으면 NULL. */
+void *frame_file_pin(struct shared_page *sp) {
+  void *frame;
+
+  lock_acquire(&frame_lock);
+  frame_file_wait(sp);
+  frame = sp->kpage;
+  if (frame != NULL) {
+    frame_lookup(frame)->pinned = true;
+  }
+  lock_release(&frame_lock);
   return frame;
 }
 
-static void cleanup_invalid_frames(void) {
-  struct list_elem *e = list_begin(&frame_table);
-  
-  while (e != list_end(&frame_table)) {
-    struct frame_table_entry *fte = list_entry(e, struct frame_table_entry, elem);
-    struct list_elem *next = list_next(e);
-    
-    if (fte->owner == NULL || fte->owner->pagedir == NULL) {
-      update_clock_hand_if_needed(e);
-      list_remove(e);
-      palloc_free_page(fte->frame);
-      free(fte);
+/* get_frame()이나 frame_get_prefetch()로 받아 SP의 내용을 채운 FRAME을
+   SP의 프레임으로 만들고 현재 스레드의 PTE를 매핑한다. 매핑하지 못해도
+   프레임은 SP에 남는다. */
+bool frame_file_install(struct shared_page *sp, void *frame,
+                        struct page_table_entry *pte, bool prefetch) {
+  struct frame_table_entry *fte;
+  bool success;
+
+  lock_acquire(&frame_lock);
+  fte = frame_lookup(frame);
+  ASSERT(fte->in_use && fte->pinned && fte->owner == thread_current());
+  ASSERT(sp->kpage == NULL);
+  list_remove(&fte->elem);
+  fte->owner = NULL;
+  fte->upage = NULL;
+  fte->file_page = sp;
+  fte->dirty = false;
+  list_init(&fte->map_ptes);
+  fte->map_cnt = 0;
+  sp->kpage = frame;
+  success = frame_file_add(fte, pte);
+  fte->pinned = false;
+  if (prefetch) {
+    fte->prefetched = true;
+    prefetch_cnt++;
+  }
+  lock_release(&frame_lock);
+  return success;
+}
+
+/* 현재 스레드의 파일 페이지 PTE의 매핑을 없앤다. 그 사이에 쫓겨났으면
+   아무 일도 하지 않는다. */
+void frame_file_unmap(struct page_table_entry *pte) {
+  lock_acquire(&frame_lock);
+  if (pte->is_loaded && pte->kpage != NULL) {
+    struct frame_table_entry *fte = frame_lookup(pte->kpage);
+
+    frame_settle_prefetch(fte, false);
+    frame_file_remove(fte, pte);
+  }
+  lock_release(&frame_lock);
+}
+
+/* 파일 페이지 SP를 가리키는 PTE가 모두 사라졌다. 프레임이 남아 있으면
+   바뀐 내용을 파일에 쓰고 유저 풀에 돌려준다. 다른 스레드가 쫓아내느라
+   쓰고 있으면 끝날 때까지 기다린다. 그동안 새로 매핑되지 않도록
+   SP->load_lock을 잡고 호출. */
+void frame_file_release(struct shared_page *sp) {
+  void *frame = NULL;
+
+  ASSERT(lock_held_by_current_thread(&sp->load_lock));
+
+  lock_acquire(&frame_lock);
+  for (;;) {
+    struct frame_table_entry *fte;
+
+    frame_file_wait(sp);
+    if (sp->kpage == NULL) {
+      break;
     }
-    
-    e = next;
+    fte = frame_lookup(sp->kpage);
+    if (frame_file_writeback(fte)) {
+      frame = fte->frame;
+      frame_file_drop(fte);
+      break;
+    }
+  }
+  lock_release(&frame_lock);
+
+  if (frame != NULL) {
+    palloc_free_page(frame);
   }
 }
 
-static void *evict_page (void) {
-  struct frame_table_entry *victim = NULL;
-  
-  if (list_empty(&frame_table)) {
-    return NULL;
+/* 파일 페이지 프레임 FTE의 매핑을 모두 없애고, 어느 매핑에서든 바뀌었으면
+   파일에 한 번 쓴 뒤 프레임을 반환한다. 쓰는 동안 다시 매핑되었으면
+   쫓아내지 않고 NULL. frame_lock을 잡고 호출. */
+static void *frame_file_evict(struct frame_table_entry *fte) {
+  frame_settle_prefetch(fte, true);
+  while (!list_empty(&fte->map_ptes)) {
+    frame_file_remove(fte, list_entry(list_front(&fte->map_ptes),
+                                      struct page_table_entry, map_elem));
   }
-  
-  cleanup_invalid_frames();
-  
-  if (list_empty(&frame_table)) {
+  if (fte->dirty) {
+    policy->write_cnt++;
+  }
+  if (!frame_file_writeback(fte)) {
     return NULL;
   }
-  
-  if (clock_hand == NULL || clock_hand == list_end(&frame_table))
-    clock_hand = list_begin(&frame_table);
+  frame_file_drop(fte);
+  return fte->frame;
+}
+
+/* COW 프레임 FTE를 스왑에 한 번 쓰고, 함께 쓰던 PTE가 모두 그 슬롯을
+   가리키게 한다. 모두 읽기 전용으로 매핑되어 있고 COW 쪽은 쓰는 동안
+   기다리므로 frame_lock을 놓고 쓴다. 빈 슬롯이 없으면 false.
+   frame_lock을 잡고 호출. */
+static bool frame_cow_evict(struct frame_table_entry *fte) {
+  size_t slot;
+  bool first = true;
+
+  frame_io_begin(&fte, 1);
+  lock_release(&frame_lock);
+  slot = swap_out(fte->frame);
+  lock_acquire(&frame_lock);
+  frame_io_end(&fte, 1);
 
-  while (true) {
-    struct frame_table_entry *fte = list_entry(clock_hand, struct frame_table_entry, elem);
+  if (slot == BITMAP_ERROR) {
+    return false;
+  }
+  policy->write_cnt++;
+
+  while (!list_empty(&fte->map_ptes)) {
+    struct page_table_entry *pte = list_entry(list_pop_front(&fte->map_ptes),
+                                              struct page_table_entry,
+                                              map_elem);
 
-    if (fte->owner == NULL || fte->owner->pagedir == NULL) {
-      clock_hand = list_next(clock_hand);
-      if (clock_hand == list_end(&frame_table))
-        clock_hand = list_begin(&frame_table);
+    pagedir_clear_page(pte->map_thread->pagedir, pte->upage);
+    if (!first) {
+      swap_share(slot);
+    }
+    first = false;
+    if (pte->swap_slot != 0) {
+      swap_free(pte->swap_slot);
+    }
+    pte->swap_slot = slot;
+    pte->original_type = pte->type;
+    pte->type = PAGE_SWAP;
+    pte->kpage = NULL;
+    pte->is_loaded = false;
+    pte->cow = false;
+  }
+  fte->map_cnt = 0;
+  frame_release(fte);
+  return true;
+}
+
+// 한 프로세스가 소유한 프레임인가 (COW나 파일 페이지 프레임이 아닌가)
+static bool frame_is_private(struct frame_table_entry *fte) {
+  return fte->map_cnt == 0 && fte->file_page == NULL;
+}
+
+/* 최근에 접근되었는가. COW나 파일 페이지 프레임이면 매핑한 PTE 중
+   하나라도. */
+static bool frame_is_accessed(struct frame_table_entry *fte) {
+  struct list_elem *e;
+
+  if (frame_is_private(fte)) {
+    return fte->owner != NULL && fte->owner->pagedir != NULL
+           && pagedir_is_accessed(fte->owner->pagedir, fte->upage);
+  }
+  for (e = list_begin(&fte->map_ptes); e != list_end(&fte->map_ptes);
+       e = list_next(e)) {
+    struct page_table_entry *pte = list_entry(e, struct page_table_entry,
+                                              map_elem);
+    if (pagedir_is_accessed(pte->map_thread->pagedir, pte->upage)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* 미리 매핑한 프레임 FTE가 접근되었으면 쓰인 것으로 센다. 프레임이나
+   매핑을 곧 놓을 때(FINAL) 접근되지 않았으면 버린 것으로 센다.
+   frame_lock을 잡고 호출. */
+static void frame_settle_prefetch(struct frame_table_entry *fte, bool final) {
+  if (!fte->prefetched) {
+    return;
+  }
+  if (frame_is_accessed(fte)) {
+    fte->prefetched = false;
+    prefetch_used_cnt++;
+  } else if (final) {
+    fte->prefetched = false;
+    prefetch_waste_cnt++;
+  }
+}
+
+// 프레임을 테이블과 소유자의 frame_list에서 뺀다. frame_lock을 잡고 호출.
+static void frame_release(struct frame_table_entry *fte) {
+  ASSERT(fte->in_use);
+  frame_settle_prefetch(fte, true);
+  if (fte->owner != NULL)
+    list_remove(&fte->elem);
+  fte->owner = NULL;
+  fte->in_use = false;
+}
+
+/* 쫓아내도 아무 일도 하지 않아도 되는 프레임인가? 소유자가 종료했거나
+   SPT에서 로드된 페이지로 보이지 않는 경우. */
+static bool frame_is_stale(struct frame_table_entry *fte) {
+  struct page_table_entry *pte;
+
+  if (!frame_is_private(fte)) {
+    return false;
+  }
+  if (fte->owner == NULL || fte->owner->pagedir == NULL) {
+    return true;
+  }
+  pte = spt_lookup(fte->owner, fte->upage);
+  return pte == NULL || !pte->is_loaded;
+}
+
+// 최근에 접근되었으면 accessed 비트를 지우고 true를 반환
+static bool frame_test_and_clear_accessed(struct frame_table_entry *fte) {
+  struct list_elem *e;
+
+  if (!frame_is_accessed(fte)) {
+    return false;
+  }
+  frame_settle_prefetch(fte, false);
+  if (frame_is_private(fte)) {
+    pagedir_set_accessed(fte->owner->pagedir, fte->upage, false);
+    return true;
+  }
+  for (e = list_begin(&fte->map_ptes); e != list_end(&fte->map_ptes);
+       e = list_next(e)) {
+    struct page_table_entry *pte = list_entry(e, struct page_table_entry,
+                                              map_elem);
+    pagedir_set_accessed(pte->map_thread->pagedir, pte->upage, false);
+  }
+  return true;
+}
+
+/* 쫓아낼 때 스왑이나 파일에 써야 하는가 (handle_eviction()과 같은 기준).
+   스왑에 최신 사본이 있는 페이지는 쓰지 않아도 된다. */
+static bool frame_needs_write(struct frame_table_entry *fte) {
+  struct page_table_entry *pte;
+  struct list_elem *e;
+  bool dirty;
+
+  if (fte->file_page != NULL) {
+    for (e = list_begin(&fte->map_ptes); e != list_end(&fte->map_ptes);
+         e = list_next(e)) {
+      pte = list_entry(e, struct page_table_entry, map_elem);
+      if (pagedir_is_dirty(pte->map_thread->pagedir, pte->upage)) {
+        return true;
+      }
+    }
+    return fte->dirty;
+  }
+  if (fte->map_cnt > 0) {
+    return true;
+  }
+  pte = spt_lookup(fte->owner, fte->upage);
+  dirty = pagedir_is_dirty(fte->owner->pagedir, fte->upage);
+  switch (pte->type) {
+    case PAGE_BINARY:
+      return (pte->writable || dirty) && (dirty || pte->swap_slot == 0);
+    case PAGE_STACK:
+      return dirty || pte->swap_slot == 0;
+    default:
+      return false;
+  }
+}
+
+// PTE의 스왑 사본을 새로 쓴 SLOT으로 바꾼다
+static void frame_set_swap_slot(struct page_table_entry *pte, size_t slot) {
+  if (pte->swap_slot != 0) {
+    swap_free(pte->swap_slot);
+  }
+  pte->swap_slot = slot;
+}
+
+// 시계 바늘을 한 칸 옮기고 지나간 엔트리를 반환
+static struct frame_table_entry *clock_advance(void) {
+  struct frame_table_entry *fte = &frame_table[clock_hand];
+
+  clock_hand = (clock_hand + 1) % frame_cnt;
+  policy->scan_cnt++;
+  return fte;
+}
+
+/* Second chance. 두 바퀴 돌면 accessed 비트가 모두 지워지므로 고정되지
+   않은 프레임이 있다면 반드시 찾는다. */
+static struct frame_table_entry *clock_select(void) {
+  size_t i;
+
+  for (i = 0; i < 2 * frame_cnt; i++) {
+    struct frame_table_entry *fte = clock_advance();
+
+    if (!fte->in_use || fte->pinned) {
       continue;
     }
+    if (frame_is_stale(fte) || !frame_test_and_clear_accessed(fte)) {
+      return fte;
+    }
+  }
+  return NULL;
+}
+
+/* Two-handed clock. 앞 바늘이 accessed 비트를 지우고 HAND_SPREAD만큼
+   뒤따르는 뒷 바늘이 그동안 다시 접근되지 않은 프레임을 쫓아낸다.
+   메모리가 커도 한 페이지가 기회를 얻는 시간이 일정하다. */
+#define HAND_SPREAD(CNT) ((CNT) / 4 > 0 ? (CNT) / 4 : 1)
+
+static struct frame_table_entry *two_hand_select(void) {
+  size_t spread = HAND_SPREAD(frame_cnt);
+  size_t i;
+
+  for (i = 0; i < 2 * frame_cnt; i++) {
+    struct frame_table_entry *front;
+    struct frame_table_entry *back;
 
-    if (fte->pinned) {
-      clock_hand = list_next(clock_hand);
-      if (clock_hand == list_end(&frame_table))
-        clock_hand = list_begin(&frame_table);
+    front = &frame_table[(clock_hand + spread) % frame_cnt];
+    if (front->in_use && !frame_is_stale(front)) {
+      frame_test_and_clear_accessed(front);
+    }
+
+    back = clock_advance();
+    if (!back->in_use || back->pinned) {
       continue;
     }
+    if (frame_is_stale(back) || !frame_is_accessed(back)) {
+      return back;
+    }
+  }
+  return NULL;
+}
 
-    struct page_table_entry *pte = spt_find(&fte->owner->spt, fte->upage);
-    
-    if (pte == NULL || !pte->is_loaded) {
-      victim = fte;
-      clock_hand = list_next(clock_hand);
-      if (clock_hand == list_end(&frame_table))
-        clock_hand = list_begin(&frame_table);
-      
-      list_remove(&victim->elem);
-      void *frame = victim->frame;
-      pagedir_clear_page(victim->owner->pagedir, victim->upage);
-      free(victim);
-      return frame;
+/* WSClock 근사. 최근에 접근되지 않은 프레임 가운데 쓰기 없이 버릴 수
+   있는 깨끗한 프레임을 우선한다. 두 바퀴 동안 깨끗한 프레임이 없으면
+   처음 본 dirty 프레임을 쫓아낸다. */
+static struct frame_table_entry *wsclock_select(void) {
+  struct frame_table_entry *dirty_victim = NULL;
+  size_t i;
+
+  for (i = 0; i < 2 * frame_cnt; i++) {
+    struct frame_table_entry *fte = clock_advance();
+
+    if (!fte->in_use || fte->pinned) {
+      continue;
+    }
+    if (frame_is_stale(fte)) {
+      return fte;
     }
+    if (frame_test_and_clear_accessed(fte)) {
+      continue;
+    }
+    if (!frame_needs_write(fte)) {
+      return fte;
+    }
+    if (dirty_victim == NULL) {
+      dirty_victim = fte;
+    }
+  }
+  return dirty_victim;
+}
 
-    // Second chance algorithm
-    if (pagedir_is_accessed(fte->owner->pagedir, fte->upage)) {
-      pagedir_set_accessed(fte->owner->pagedir, fte->upage, false);
-      clock_hand = list_next(clock_hand);
-      if (clock_hand == list_end(&frame_table)) {
-        clock_hand = list_begin(&frame_table);
-      }
+/* 프레임 하나를 쫓아내 반환한다. 스왑이나 파일에 쓰는 동안 frame_lock을
+   놓으므로, 그 사이에 페이지가 바뀌거나 다시 매핑되어 포기하면 다른
+   프레임을 고른다. */
+static void *evict_page (void) {
+  struct frame_table_entry *victim;
+  size_t tries;
+
+  for (tries = 0; tries < frame_cnt; tries++) {
+    void *frame;
+
+    victim = policy->select();
+    if (victim == NULL) {
+      return NULL;
+    }
+
+    if (victim->file_page != NULL) {
+      frame = frame_file_evict(victim);
+    } else if (victim->map_cnt > 0) {
+      frame = frame_cow_evict(victim) ? victim->frame : NULL;
+    } else if (victim->owner == NULL || victim->owner->pagedir == NULL) {
+      // 소유자가 이미 종료한 프레임은 바로 재사용
+      frame_release(victim);
+      frame = victim->frame;
     } else {
-      victim = fte;
-      clock_hand = list_next(clock_hand);
-      if (clock_hand == list_end(&frame_table)) {
-        clock_hand = list_begin(&frame_table);
-      }
+      frame = handle_eviction(victim);
+    }
+    if (frame != NULL) {
+      policy->evict_cnt++;
+      return frame;
+    }
+  }
+  return NULL;
+}
+
+/* 쫓아낼 VICTIM(PTE)을 스왑에 쓰고 매핑을 없앤다. 바로 다음 가상
+   페이지들도 같은 소유자의 스왑 대상 페이지이고 고정되지 않았으며 최근에
+   접근되지 않았으면 함께 쫓아내 연속된 슬롯에 한 번의 요청으로 쓴다.
+   그래서 다시 폴트날 때 page_swap_in()이 한꺼번에 미리 읽을 수 있다.
+   함께 쫓아낸 프레임은 유저 풀에 돌려준다.
+
+   쓰는 동안에는 프레임들을 고정하고 frame_lock을 놓는다. 소유자는 그동안
+   페이지를 계속 쓸 수 있으므로, 쓰는 사이에 바뀐 페이지는 쫓아내지 않고
+   그 슬롯을 버린다. VICTIM이 바뀌었거나 빈 슬롯이 없으면 false.
+   frame_lock을 잡고 호출. */
+static bool frame_swap_out(struct frame_table_entry *victim,
+                           struct page_table_entry *pte) {
+  struct thread *owner = victim->owner;
+  struct frame_table_entry *ftes[SWAP_CLUSTER];
+  struct page_table_entry *ptes[SWAP_CLUSTER];
+  void *frames[SWAP_CLUSTER];
+  size_t cnt = 1;
+  size_t written;
+  size_t slot, i;
+
+  ftes[0] = victim;
+  ptes[0] = pte;
+  frames[0] = victim->frame;
+  while (cnt < SWAP_CLUSTER) {
+    void *upage = victim->upage + cnt * PGSIZE;
+    struct page_table_entry *next;
+    struct frame_table_entry *fte;
+
+    if (!is_user_vaddr(upage)) {
+      break;
+    }
+    next = spt_lookup(owner, upage);
+    if (next == NULL || !next->is_loaded || next->kpage == NULL
+        || next->readahead
+        || (next->type != PAGE_STACK
+            && !(next->type == PAGE_BINARY && next->writable))) {
+      break;
+    }
+    fte = frame_lookup(next->kpage);
+    if (!fte->in_use || fte->pinned || fte->owner != owner
+        || pagedir_is_accessed(owner->pagedir, upage)) {
       break;
     }
+    ftes[cnt] = fte;
+    ptes[cnt] = next;
+    frames[cnt] = next->kpage;
+    cnt++;
   }
-  
-  void *result = handle_eviction(victim);
-  return result;
+
+  // 쓰는 도중에 바뀌면 다시 dirty가 되도록 먼저 지운다
+  for (i = 0; i < cnt; i++) {
+    pagedir_set_dirty(owner->pagedir, ptes[i]->upage, false);
+  }
+  frame_io_begin(ftes, cnt);
+  lock_release(&frame_lock);
+
+  written = cnt;
+  slot = cnt > 1 ? swap_out_cluster(frames, cnt) : BITMAP_ERROR;
+  if (slot == BITMAP_ERROR) {
+    // 연속된 슬롯이 없으면 한 페이지만
+    written = 1;
+    slot = swap_out(frames[0]);
+  }
+
+  lock_acquire(&frame_lock);
+  frame_io_end(ftes, cnt);
+
+  // 쓰지 못한 페이지는 바뀌었을 수 있으므로 dirty로 되돌린다
+  for (i = slot == BITMAP_ERROR ? 0 : written; i < cnt; i++) {
+    pagedir_set_dirty(owner->pagedir, ptes[i]->upage, true);
+  }
+  if (slot == BITMAP_ERROR) {
+    return false;
+  }
+  policy->write_cnt += written;
+
+  for (i = 1; i < written; i++) {
+    if (!frame_unmap_if_clean(owner->pagedir, ptes[i]->upage)) {
+      swap_free(slot + i);
+      continue;
+    }
+    frame_set_swap_slot(ptes[i], slot + i);
+    ptes[i]->kpage = NULL;
+    ptes[i]->is_loaded = false;
+    ptes[i]->original_type = ptes[i]->type;
+    ptes[i]->type = PAGE_SWAP;
+    frame_release(ftes[i]);
+    palloc_free_page(frames[i]);
+  }
+
+  if (!frame_unmap_if_clean(owner->pagedir, pte->upage)) {
+    swap_free(slot);
+    return false;
+  }
+  frame_set_swap_slot(pte, slot);
+  return true;
 }
 
 static void *handle_eviction(struct frame_table_entry *victim) {
@@ -150,14 +1071,11 @@ static void *handle_eviction(struct frame_table_entry *victim) {
   void *upage = victim->upage;
   struct thread *owner = victim->owner;
   
-  // frame_table에서 제거
-  list_remove(&victim->elem);
-  
   // PTE 찾기
-  pte = spt_find(&owner->spt, upage);
+  pte = spt_lookup(owner, upage);
   if (pte == NULL) {
     pagedir_clear_page(owner->pagedir, upage);
-    free(victim);
+    frame_release(victim);
     return frame;
   }
 
@@ -165,7 +1083,7 @@ static void *handle_eviction(struct frame_table_entry *victim) {
     pagedir_clear_page(owner->pagedir, upage);
     pte->is_loaded = false;
     pte->kpage = NULL;
-    free(victim);
+    frame_release(victim);
     return frame;
   }
 
@@ -173,105 +1091,65 @@ static void *handle_eviction(struct frame_table_entry *victim) {
     pagedir_clear_page(owner->pagedir, upage);
     pte->is_loaded = false;
     pte->kpage = NULL;
-    free(victim);
+    frame_release(victim);
     return frame;
   }
 
   bool dirty = pagedir_is_dirty(owner->pagedir, upage);
-  
-  pte->is_loaded = false;
-  
-  size_t swap_slot = 0;
   bool need_swap = false;
 
   switch (pte->type) {
     case PAGE_BINARY:
-      if (pte->writable || dirty) {
-        swap_slot = swap_out(frame);        
-        if (swap_slot == BITMAP_ERROR) {
-          pte->is_loaded = true;
-          list_push_back(&frame_table, &victim->elem);
-          return NULL;
-        }
-        need_swap = true;
-      } else {
-
-      }
+      need_swap = pte->writable || dirty;
       break;
     
     case PAGE_STACK:
-      {
-        swap_slot = swap_out(frame);
-        if (swap_slot == BITMAP_ERROR) {
-          pte->is_loaded = true;
-          list_push_back(&frame_table, &victim->elem);
-          return NULL;
-        }
-        need_swap = true;
-      }
-      break;
-      
-    case PAGE_MMAP:
-      if (dirty) {
-        lock_acquire(&filesys_lock);
-        file_write_at(pte->file, frame, pte->read_bytes, pte->file_offset);
-        lock_release(&filesys_lock);
-      }
+      need_swap = true;
       break;
 
     default:
-      pagedir_clear_page(owner->pagedir, upage);
-      pte->kpage = NULL;
-      free(victim);
-      return frame;
+      break;
   }
-  
-  // page directory에서 매핑 제거
-  pagedir_clear_page(owner->pagedir, upage);
+
+  if (!need_swap) {
+    pagedir_clear_page(owner->pagedir, upage);
+  } else if (dirty || pte->swap_slot == 0) {
+    // 스왑에 쓰는 동안 frame_lock을 놓는다
+    if (!frame_swap_out(victim, pte)) {
+      return NULL;
+    }
+  } else if (!frame_unmap_if_clean(owner->pagedir, upage)) {
+    // page cleaner가 미리 써 둔 사본이 있지만 그 사이에 바뀌었다
+    return NULL;
+  }
+
+  pte->is_loaded = false;
+  pte->readahead = false;
   pte->kpage = NULL;
-  
   if (need_swap) {
-    pte->swap_slot = swap_slot;
     pte->original_type = pte->type;
     pte->type = PAGE_SWAP;
   }
   
-  free(victim);
+  frame_release(victim);
   
   return frame;
 }
 
-static void update_clock_hand_if_needed(struct list_elem *removed_elem) {
-  if (clock_hand == removed_elem) {
-    clock_hand = list_next(clock_hand);
-    if (clock_hand == list_end(&frame_table)) {
-      clock_hand = list_begin(&frame_table);
-    }
-  }
-}
-
 void free_frame (void *frame) {
+  struct frame_table_entry *fte;
+  bool found = false;
+
   if (frame == NULL) {
     return;
   }
 
   lock_acquire(&frame_lock);
-
-  struct list_elem *e;
-  bool found = false;
-
-  for (e = list_begin(&frame_table); e != list_end(&frame_table); e = list_next(e)) {
-    struct frame_table_entry *fte = list_entry(e, struct frame_table_entry, elem);
-    if (fte->frame == frame) {
-      update_clock_hand_if_needed(e);
-      
-      list_remove(e);
-      found = true;
-      free(fte);
-      break;
-    }
+  fte = frame_lookup(frame);
+  if (fte->in_use) {
+    frame_release(fte);
+    found = true;
   }
-
   lock_release(&frame_lock);
 
   if (found) {
@@ -279,38 +1157,122 @@ void free_frame (void *frame) {
   }
 }
 
+// T가 소유한 프레임만 훑으므로 O(T의 프레임 수)
 void frame_clear_owner(struct thread *t) {
   lock_acquire(&frame_lock); 
 
-  struct list_elem *e = list_begin(&frame_table);
-  
-  while (e != list_end(&frame_table)) {
+  while (!list_empty(&t->frame_list)) {
+    struct list_elem *e = list_front(&t->frame_list);
     struct frame_table_entry *fte = list_entry(e, struct frame_table_entry, elem);
-    struct list_elem *next = list_next(e);
-    
-    if (fte->owner == t) {
-      if (is_kernel_vaddr(fte->upage)) {
-        e = next;
-        continue;
-      }
-      
-      void *frame = fte->frame;
-      void *upage = fte->upage;
-      
-      if (t->pagedir != NULL) {
-        pagedir_clear_page(t->pagedir, upage);
-      }
-      
-      update_clock_hand_if_needed(e);
-      
-      list_remove(e);
-      free(fte);
+    void *frame = fte->frame;
 
-      palloc_free_page(frame);
+    // 다른 스레드가 쫓아내느라 쓰는 중이면 끝나기를 기다린다
+    if (fte->io) {
+      cond_wait(&io_cond, &frame_lock);
+      continue;
     }
-    
-    e = next;
+    list_pop_front(&t->frame_list);
+
+    // 커널 주소에 매핑된 프레임은 남겨 두고, 소유자만 끊는다
+    frame_settle_prefetch(fte, true);
+    fte->owner = NULL;
+    if (is_kernel_vaddr(fte->upage)) {
+      continue;
+    }
+
+    if (t->pagedir != NULL) {
+      pagedir_clear_page(t->pagedir, fte->upage);
+    }
+    frame_release(fte);
+    palloc_free_page(frame);
   }
   
   lock_release(&frame_lock);  
-}
\ No newline at end of file
+}
+
+/* FTE의 페이지를 쫓아내지 않고 스왑에 미리 쓴다. dirty 비트를 먼저
+   지우므로 쓰는 도중에 페이지가 바뀌면 다시 dirty가 된다. 쓰는 동안에는
+   FTE를 고정하고 frame_lock을 놓는다. frame_lock을 잡고 호출. */
+static bool frame_clean(struct frame_table_entry *fte) {
+  uint32_t *pd = fte->owner->pagedir;
+  struct page_table_entry *pte = spt_lookup(fte->owner, fte->upage);
+  size_t slot;
+
+  if (pte->type != PAGE_BINARY && pte->type != PAGE_STACK) {
+    return false;
+  }
+
+  pagedir_set_dirty(pd, fte->upage, false);
+  frame_io_begin(&fte, 1);
+  lock_release(&frame_lock);
+  slot = swap_out(fte->frame);
+  lock_acquire(&frame_lock);
+  frame_io_end(&fte, 1);
+
+  if (slot == BITMAP_ERROR) {
+    pagedir_set_dirty(pd, fte->upage, true);
+    return false;
+  }
+  frame_set_swap_slot(pte, slot);
+  return true;
+}
+
+/* 시계 바늘 하나로 프레임을 한 바퀴 돌면서 최근에 접근되지 않은 dirty
+   프레임을 최대 CLEANER_BATCH개 미리 쓰고, 빈 프레임이 HIGH_WATER가 될
+   때까지 깨끗한 프레임을 풀어 준다. 폴트 중인 스레드가 오래 기다리지
+   않도록 프레임 하나마다 frame_lock을 놓는다. 로드 중인 프레임과 구분할
+   수 없으므로 stale 프레임은 건드리지 않는다. */
+static void frame_clean_pass(void) {
+  size_t free_cnt = palloc_user_free_cnt();
+  size_t written = 0;
+  size_t i;
+
+  for (i = 0; i < frame_cnt && free_cnt < high_water; i++) {
+    struct frame_table_entry *fte;
+
+    lock_acquire(&frame_lock);
+    fte = &frame_table[cleaner_hand];
+    cleaner_hand = (cleaner_hand + 1) % frame_cnt;
+
+    // 아무도 매핑하지 않은 깨끗한 파일 페이지 프레임은 쓰기 없이 풀어 준다.
+    // 그 밖의 COW와 파일 페이지 프레임은 폴트 경로의 eviction에만 맡긴다.
+    if (fte->in_use && !fte->pinned && fte->file_page != NULL
+        && fte->map_cnt == 0 && !fte->dirty) {
+      void *frame = fte->frame;
+
+      frame_file_drop(fte);
+      palloc_free_page(frame);
+      free_cnt++;
+      reclaim_cnt++;
+    } else if (fte->in_use && !fte->pinned && frame_is_private(fte)
+        && !frame_is_stale(fte)
+        && !pagedir_is_accessed(fte->owner->pagedir, fte->upage)) {
+      if (frame_needs_write(fte) && written < CLEANER_BATCH
+          && frame_clean(fte)) {
+        written++;
+        cleaned_cnt++;
+      }
+      if (!frame_needs_write(fte)) {
+        void *frame = handle_eviction(fte);
+        if (frame != NULL) {
+          palloc_free_page(frame);
+          free_cnt++;
+          reclaim_cnt++;
+        }
+      }
+    }
+    lock_release(&frame_lock);
+  }
+}
+
+// get_frame()이 빈 프레임이 부족하다고 깨울 때마다 한 바퀴 돈다
+static void page_cleaner(void *aux UNUSED) {
+  for (;;) {
+    sema_down(&cleaner_sema);
+    frame_clean_pass();
+
+    lock_acquire(&frame_lock);
+    cleaner_running = false;
+    lock_release(&frame_lock);
+  }
+}
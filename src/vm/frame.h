@@ -4,19 +4,46 @@
 #include <list.h>
 #include "threads/thread.h"
 #include "threads/palloc.h"
+#include "vm/page.h"
 
+/* 유저 풀의 물리 프레임 하나. frame_table[]에서 프레임 번호로 바로 찾는다. */
 struct frame_table_entry {
   void *frame;
   void *upage;
   struct thread *owner;
   bool pinned;
+  bool in_use;
 
-  struct list_elem elem;
+  struct list_elem elem;        /* owner->frame_list의 원소 */
+
+  unsigned map_cnt;             /* 이 프레임을 매핑한 PTE 수 (COW, 파일 페이지) */
+  struct list map_ptes;         /* 매핑한 PTE들 (map_cnt > 0일 때) */
+  struct shared_page *file_page;  /* mmap한 파일 페이지의 프레임이면 non-NULL */
+  bool dirty;                   /* file_page: 매핑을 없앤 PTE들의 dirty 비트 */
+
+  bool prefetched;              /* fault-around로 매핑한 뒤 접근을 아직 못 봄 */
+  bool io;                      /* frame_lock 밖에서 스왑에 쓰는 중 */
 };
 
 void frame_init(void);
 void *get_frame(enum palloc_flags flags, void *upage);
+void *try_get_frame(void *upage);
+void frame_unpin(void *frame);
+void *frame_get_prefetch(void *upage);
+void frame_set_prefetched(void *frame);
+bool frame_cow_share(struct thread *parent, struct page_table_entry *ppte,
+                     struct page_table_entry *cpte);
+void *frame_cow_break(struct page_table_entry *pte);
+void frame_cow_unref(struct page_table_entry *pte);
+bool frame_file_map(struct shared_page *sp, struct page_table_entry *pte);
+bool frame_file_install(struct shared_page *sp, void *frame,
+                        struct page_table_entry *pte, bool prefetch);
+void *frame_file_pin(struct shared_page *sp);
+void frame_file_unmap(struct page_table_entry *pte);
+void frame_file_release(struct shared_page *sp);
 void free_frame(void *frame);
 void frame_clear_owner(struct thread *t);
+bool frame_set_policy(const char *name);
+void frame_print_stats(void);
 
-#endif
\ No newline at end of file
+#endif
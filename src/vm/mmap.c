@@ -1,6 +1,6 @@
 #include "vm/mmap.h"
 #include "threads/thread.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/vaddr.h"
 #include "filesys/file.h"
 #include "userprog/pagedir.h"
@@ -8,62 +8,50 @@
 #include "vm/page.h"
 #include "vm/swap.h"
 #include "vm/stack.h"
+#include "vm/vma.h"
+#include <round.h>
 #include <string.h>
 #include "userprog/syscall.h"
 
-extern struct lock filesys_lock;
-
 static struct mmap_entry *mmap_find_entry(struct thread *t, mapid_t mapping);
-static void mmap_cleanup_on_fail(size_t count, void *addr, struct file *file);
+
+static struct slab_cache *mmap_cache;
+
+void mmap_init(void) {
+  mmap_cache = slab_cache_create("mmap entry", sizeof(struct mmap_entry), NULL);
+}
 
 mapid_t mmap_insert(struct file *file_reopen, int fd, void *addr, off_t file_length, bool writable) {
   struct thread *cur = thread_current();
   size_t page_count = (file_length + PGSIZE - 1) / PGSIZE;
 
   if (pg_ofs(addr) != 0) {
-    lock_acquire(&filesys_lock);
     file_close(file_reopen);
-    lock_release(&filesys_lock);
     return -1;
   }
 
   if (!is_user_vaddr(addr) || addr == 0) {
-    lock_acquire(&filesys_lock);
     file_close(file_reopen);
-    lock_release(&filesys_lock);
     return -1;
   }
   
-  for (size_t i = 0; i < page_count; i++) {
-    void *upage = addr + (i * PGSIZE);
-
-    if (spt_find(&cur->spt, upage) != NULL) {
-      lock_acquire(&filesys_lock);
-      file_close(file_reopen);
-      lock_release(&filesys_lock);
-      return -1;
-    }
-    
-    if (pagedir_get_page(cur->pagedir, upage) != NULL) {
-        lock_acquire(&filesys_lock);
-        file_close(file_reopen);
-        lock_release(&filesys_lock);
-        return -1;
-    }
-
-    if (upage >= (void *)(PHYS_BASE - STACK_MAX_SIZE) && upage < PHYS_BASE) {
-        lock_acquire(&filesys_lock);
-        file_close(file_reopen);
-        lock_release(&filesys_lock);
-        return -1;
-    }
+  if (check_mmap_overlap(addr, file_length)) {
+    file_close(file_reopen);
+    return -1;
   }
-  
-  struct mmap_entry *me = malloc(sizeof(struct mmap_entry));
+
+  struct mmap_entry *me = slab_alloc(mmap_cache);
   if (me == NULL) {
-    lock_acquire(&filesys_lock);
     file_close(file_reopen);
-    lock_release(&filesys_lock);
+    return -1;
+  }
+
+  // 페이지별 PTE는 처음 접근할 때 spt_get_page()가 영역에서 만든다
+  struct vma *vma = vma_create(&cur->vmas, addr, file_length, file_reopen,
+                               0, file_length, writable);
+  if (vma == NULL) {
+    slab_free(mmap_cache, me);
+    file_close(file_reopen);
     return -1;
   }
   
@@ -73,83 +61,57 @@ mapid_t mmap_insert(struct file *file_reopen, int fd, void *addr, off_t file_len
   me->addr = addr;
   me->length = file_length;
   me->page_count = page_count;
-  
-  // 각 페이지에 대한 PTE 생성
-  for (size_t i = 0; i < page_count; i++) {
-    void *upage = addr + (i * PGSIZE);
-    off_t offset = i * PGSIZE;
-    size_t read_bytes = (offset + PGSIZE < file_length) ? PGSIZE : (file_length - offset);
-    size_t zero_bytes = PGSIZE - read_bytes;
-    
-    struct page_table_entry *pte = malloc(sizeof(struct page_table_entry));
-    if (pte == NULL) {
-      mmap_cleanup_on_fail(i, addr, file_reopen);
-      free(me);
-      return -1;
-    }
-    
-    memset(pte, 0, sizeof(*pte));
-    pte->upage = upage;
-    pte->kpage = NULL;
-    pte->is_loaded = false;
-    pte->type = PAGE_MMAP;
-    pte->original_type = PAGE_MMAP;
-    pte->file = file_reopen;
-    pte->file_offset = offset;
-    pte->read_bytes = read_bytes;
-    pte->zero_bytes = zero_bytes;
-    pte->writable = writable;
-    pte->mapid = me->mapid;
-    pte->swap_slot = 0;
-   
-    if (!spt_insert(&cur->spt, pte)) {
-      free(pte);
-      mmap_cleanup_on_fail(i, addr, file_reopen);
-      free(me);
-      return -1;
-    }
-  }
+  vma->type = PAGE_MMAP;
+  vma->mapid = me->mapid;
   
   list_push_back(&cur->mmap_list, &me->elem);
   return me->mapid;
 }
 
+/* fork()한 자식(현재 스레드)에 부모 PARENT의 매핑을 같은 주소와 mapid로
+   만든다. 영역은 vma_fork()가 이미 복사했다. 자식은 처음 접근할 때
+   파일 페이지 캐시에서 부모와 같은 프레임을 매핑한다. */
+bool mmap_fork(struct thread *parent) {
+  struct thread *cur = thread_current();
+  struct list_elem *e;
+
+  cur->next_mapid = parent->next_mapid;
+  for (e = list_begin(&parent->mmap_list); e != list_end(&parent->mmap_list);
+       e = list_next(e)) {
+    struct mmap_entry *pme = list_entry(e, struct mmap_entry, elem);
+    struct mmap_entry *me = slab_alloc(mmap_cache);
+
+    if (me == NULL) {
+      return false;
+    }
+    *me = *pme;
+    me->file = vma_find(&cur->vmas, me->addr)->file;
+    list_push_back(&cur->mmap_list, &me->elem);
+  }
+  return true;
+}
+
 void mmap_munmap(struct thread *t, mapid_t mapping) {
   struct mmap_entry *me = mmap_find_entry(t, mapping);
   
   if (me == NULL)
     return;
   
-  // 각 페이지 정리
+  // 각 페이지 정리. 바뀐 내용은 마지막 매핑이 없어질 때 파일
+  // 페이지 캐시가 파일에 쓴다.
   for (size_t i = 0; i < me->page_count; i++) {
     void *upage = me->addr + (i * PGSIZE);
     struct page_table_entry *pte = spt_find(&t->spt, upage);
     
-    if (pte == NULL)
-      continue;
-    
-    // dirty 페이지를 파일에 write back
-    if (pte->is_loaded && pte->kpage != NULL) {
-      if (pagedir_is_dirty(t->pagedir, upage)) {
-        lock_acquire(&filesys_lock);
-        file_write_at(pte->file, pte->kpage, pte->read_bytes, pte->file_offset);
-        lock_release(&filesys_lock);
-      }
-      pagedir_clear_page(t->pagedir, upage);
-      free_frame(pte->kpage);
-    }
-    
-    hash_delete(&t->spt, &pte->elem);
-    
-    free(pte);
+    if (pte != NULL)
+      spt_remove(&t->spt, pte);
   }
   
-  lock_acquire(&filesys_lock);
-  file_close(me->file);
-  lock_release(&filesys_lock);
+  // 영역이 파일을 닫는다
+  vma_remove(&t->vmas, vma_find(&t->vmas, me->addr));
   
   list_remove(&me->elem);
-  free(me);
+  slab_free(mmap_cache, me);
 }
 
 void mmap_unmap_all(struct thread *t) {
@@ -171,50 +133,15 @@ static struct mmap_entry *mmap_find_entry(struct thread *t, mapid_t mapping) {
   return NULL;
 }
 
-static void mmap_cleanup_on_fail(size_t count, void *addr, struct file *file) {
-  struct thread *cur = thread_current();
-  
-  for (size_t i = 0; i < count; i++) {
-    void *upage = addr + (i * PGSIZE);
-    struct page_table_entry *pte = spt_find(&cur->spt, upage);
-    
-    if (pte != NULL) {
-      spt_remove(&cur->spt, pte);
-    }
-  }
-  
-  lock_acquire(&filesys_lock);
-  file_close(file);
-  lock_release(&filesys_lock);
-}
-
-void mmap_write_back(struct page_table_entry *pte) {
-  if (pte == NULL || pte->type != PAGE_MMAP) {
-    return;
-  }
-  
-  if (pte->is_loaded && pte->kpage != NULL && pte->file != NULL) {
-    file_write_at(pte->file, pte->kpage, pte->read_bytes, pte->file_offset);
-  }
-}
-
+/* [ADDR, ADDR + LENGTH)가 다른 영역이나 스택 영역과 겹치면 true.
+   실행 파일과 mmap은 모두 영역이고 그 밖의 페이지는 스택뿐이므로
+   페이지마다 찾아볼 필요가 없다. */
 bool check_mmap_overlap(void *addr, off_t length) {
   struct thread *t = thread_current();
-  void *end_addr = addr + length;
+  void *end_addr = addr + ROUND_UP(length, PGSIZE);
 
-  for (void *page_addr = addr; page_addr < end_addr; page_addr += PGSIZE) {
-    if (spt_find(&t->spt, page_addr) != NULL) {
-      return true;
-    }
-    
-    if (pagedir_get_page(t->pagedir, page_addr) != NULL) {
-      return true;
-    }
-    
-    if (page_addr >= (void *)(PHYS_BASE - STACK_MAX_SIZE) && page_addr < PHYS_BASE) {
-      return true; 
-    }
+  if (end_addr > (void *)(PHYS_BASE - STACK_MAX_SIZE) || end_addr < addr) {
+    return true;
   }
-  
-  return false;
-}
\ No newline at end of file
+  return vma_overlaps(&t->vmas, addr, end_addr);
+}
@@ -17,10 +17,11 @@ struct mmap_entry {
   struct list_elem elem;
 };
 
+void mmap_init(void);
 mapid_t mmap_insert(struct file *file_reopen, int fd, void *addr, off_t length, bool writable);
 void mmap_munmap(struct thread *t, mapid_t mapping);
 void mmap_unmap_all(struct thread *t);
-void mmap_write_back(struct page_table_entry *pte);
+bool mmap_fork(struct thread *parent);
 
 bool check_mmap_overlap(void *addr, off_t length);
 
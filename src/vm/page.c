@@ -1,6 +1,7 @@
 #include <stdlib.h>
+#include <round.h>
 #include <string.h>
-#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include "filesys/file.h"
 #include "userprog/pagedir.h"
@@ -8,11 +9,31 @@
 #include "vm/frame.h"
 #include "vm/swap.h"
 #include "vm/mmap.h"
+#include "vm/share.h"
+#include "vm/vma.h"
 #include "userprog/syscall.h"
 
 static void cleanup_pte_resources(struct page_table_entry *pte);
 static void spt_destroy_func(struct hash_elem *e, void *aux UNUSED);
 
+// 모든 PTE는 이 캐시에서 할당한다
+static struct slab_cache *pte_cache;
+
+int fault_around_pages = FAULT_AROUND_DEFAULT;
+
+void page_init(void) {
+  pte_cache = slab_cache_create("page table entry",
+                                sizeof(struct page_table_entry), NULL);
+}
+
+struct page_table_entry *pte_alloc(void) {
+  return slab_alloc(pte_cache);
+}
+
+void pte_free(struct page_table_entry *pte) {
+  slab_free(pte_cache, pte);
+}
+
 void spt_init(struct hash *spt) {
   hash_init(spt, page_hash, page_less, NULL);
 }
@@ -28,13 +49,24 @@ bool page_less(const struct hash_elem *a, const struct hash_elem *b, void *aux U
   return pte_a->upage < pte_b->upage;
 }
 
+/* SPT는 그 스레드만 바꾸지만, 다른 스레드의 eviction이 spt_lookup()으로
+   찾아볼 수 있다. PTE를 폴트 때 만들게 된 뒤로는 프로세스가 실행 중에도
+   SPT가 자라고 hash_insert()가 버킷을 옮기므로, 바꾸는 동안에는
+   spt_lock을 잡는다. spt_lock은 frame_lock 다음에 잡으며, 잡은 채로
+   다른 락을 기다리지 않는다. */
 bool spt_insert(struct hash *spt, struct page_table_entry *pte) {
-  struct hash_elem *old_elem = hash_insert(spt, &pte->elem);
+  struct thread *cur = thread_current();
+  struct hash_elem *old_elem;
+
+  ASSERT(spt == &cur->spt);
+  lock_acquire(&cur->spt_lock);
+  old_elem = hash_insert(spt, &pte->elem);
+  lock_release(&cur->spt_lock);
   return old_elem == NULL;
 }
 
 struct page_table_entry *spt_create_page(struct hash *spt, void *upage) {
-  struct page_table_entry *pte = malloc(sizeof(struct page_table_entry));
+  struct page_table_entry *pte = pte_alloc();
   if (pte == NULL) {
     return NULL;
   }
@@ -51,12 +83,35 @@ struct page_table_entry *spt_create_page(struct hash *spt, void *upage) {
   pte->read_bytes = 0;
   pte->zero_bytes = 0;
   pte->swap_slot = 0;
+  pte->readahead = false;
+  pte->shared = NULL;
+  pte->cow = false;
   pte->mapid = -1;
   
   if(!spt_insert(spt, pte)) {
-    free(pte);
+    pte_free(pte);
+    return NULL;
+  }
+  return pte;
+}
+
+/* T의 UPAGE에 대한 PTE를 돌려준다. 아직 없으면 UPAGE가 속한 영역에서
+   만든다. UPAGE가 어느 영역에도 속하지 않거나 메모리가 없으면 NULL. */
+struct page_table_entry *spt_get_page(struct thread *t, void *upage) {
+  struct page_table_entry *pte = spt_find(&t->spt, upage);
+  struct vma *vma;
+
+  if (pte != NULL) {
+    return pte;
+  }
+  vma = vma_find(&t->vmas, upage);
+  if (vma == NULL) {
     return NULL;
   }
+  pte = spt_create_page(&t->spt, upage);
+  if (pte != NULL) {
+    vma_fill_page(vma, pte);
+  }
   return pte;
 }
 
@@ -70,29 +125,47 @@ struct page_table_entry *spt_find(struct hash *spt, void *upage) {
   return e != NULL ? hash_entry(e, struct page_table_entry, elem) : NULL;
 }
 
+/* 다른 스레드일 수 있는 T의 SPT에서 UPAGE의 PTE를 찾는다 (eviction용).
+   T의 프레임이 테이블에 있는 동안 T는 그 PTE를 지우지 않는다. */
+struct page_table_entry *spt_lookup(struct thread *t, void *upage) {
+  struct page_table_entry *pte;
+
+  lock_acquire(&t->spt_lock);
+  pte = spt_find(&t->spt, upage);
+  lock_release(&t->spt_lock);
+  return pte;
+}
+
 static void cleanup_pte_resources(struct page_table_entry *pte) {
   if (pte == NULL) {
     return;
   }
 
+  // 함께 쓰던 COW 프레임은 마지막 프로세스가 놓을 때 해제된다
+  if (pte->cow) {
+    struct thread *t = thread_current();
+    if (t->pagedir != NULL) {
+      pagedir_clear_page(t->pagedir, pte->upage);
+    }
+    frame_cow_unref(pte);
+  }
+
   switch (pte->type) {
     case PAGE_BINARY:
-      if (pte->file != NULL) {
-        lock_acquire(&filesys_lock);
-        file_close(pte->file);
-        lock_release(&filesys_lock);
-        pte->file = NULL;
+      // pagedir_destroy()가 공유 프레임을 해제하지 않도록 매핑을 먼저 없앤다
+      if (pte->shared != NULL) {
+        share_unmap(pte);
       }
       break;
       
     case PAGE_SWAP:
-      if (pte->swap_slot != 0) {
-        swap_free(pte->swap_slot);
-        pte->swap_slot = 0;
-      }
       break;
       
     case PAGE_MMAP:
+      // 마지막 매핑이면 파일 페이지 캐시가 바뀐 내용을 파일에 쓴다
+      if (pte->shared != NULL) {
+        share_unmap(pte);
+      }
       break;
 
     case PAGE_STACK:
@@ -101,6 +174,12 @@ static void cleanup_pte_resources(struct page_table_entry *pte) {
     default:
       break;
   }
+
+  // 메모리에 있는 페이지도 page cleaner가 미리 써 둔 스왑 사본을 가질 수 있다
+  if (pte->swap_slot != 0) {
+    swap_free(pte->swap_slot);
+    pte->swap_slot = 0;
+  }
 }
 
 void spt_remove(struct hash *spt, struct page_table_entry *pte) {
@@ -108,16 +187,20 @@ void spt_remove(struct hash *spt, struct page_table_entry *pte) {
     return;
   }
   
+  struct thread *t = thread_current();
+
+  ASSERT(spt == &t->spt);
+  lock_acquire(&t->spt_lock);
   hash_delete(spt, &pte->elem);
+  lock_release(&t->spt_lock);
   
-  struct thread *t = thread_current();
   if (t->pagedir != NULL && pte->upage != NULL) {
     pagedir_clear_page(t->pagedir, pte->upage);
   }
   
   cleanup_pte_resources(pte);
   
-  free(pte);
+  pte_free(pte);
 }
 
 void spt_remove_page(struct hash *spt, void *upage) {
@@ -130,9 +213,177 @@ void spt_remove_page(struct hash *spt, void *upage) {
 static void spt_destroy_func(struct hash_elem *e, void *aux UNUSED) {
   struct page_table_entry *pte = hash_entry(e, struct page_table_entry, elem);
   cleanup_pte_resources(pte);
-  free(pte);
+  pte_free(pte);
 }
 
+/* frame_clear_owner() 다음에 부르므로 다른 스레드가 이 SPT를 찾아보지
+   않는다. */
 void spt_destroy(struct hash *spt) {
   hash_destroy(spt, spt_destroy_func);
 }
+
+/* fork()한 자식(현재 스레드)의 SPT를 부모 PARENT의 SPT로 채운다.
+   페이지 내용은 frame_cow_share()가 나누고, mmap 페이지는 자식이 처음
+   접근할 때 파일에서 읽는다. 파일은 vma_fork()가 만든 자식의 영역에서
+   빌린다. 실패해도 이미 넣은 PTE는 spt_destroy()로 정리할 수 있다. */
+bool spt_fork(struct thread *parent) {
+  struct thread *cur = thread_current();
+  struct hash_iterator i;
+
+  hash_first(&i, &parent->spt);
+  while (hash_next(&i)) {
+    struct page_table_entry *ppte = hash_entry(hash_cur(&i),
+                                               struct page_table_entry, elem);
+    struct page_table_entry *cpte;
+
+    if (ppte->type == PAGE_MMAP) {
+      continue;
+    }
+    cpte = pte_alloc();
+    if (cpte == NULL) {
+      return false;
+    }
+    memcpy(cpte, ppte, sizeof *cpte);
+    cpte->kpage = NULL;
+    cpte->is_loaded = false;
+    cpte->file = NULL;
+    cpte->swap_slot = 0;
+    cpte->readahead = false;
+    cpte->shared = NULL;
+    cpte->cow = false;
+    if (!spt_insert(&cur->spt, cpte)) {
+      pte_free(cpte);
+      return false;
+    }
+
+    if (ppte->file != NULL) {
+      cpte->file = vma_find(&cur->vmas, cpte->upage)->file;
+    }
+    if (!frame_cow_share(parent, ppte, cpte)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* PAGE_SWAP인 PTE를 FRAME으로 읽어 들인다. 바로 다음 가상 페이지들이
+   이어지는 스왑 슬롯에 있고 빈 프레임이 있으면 (swap-out clustering이
+   그렇게 만든다) 한 번의 요청으로 함께 읽는다. 미리 읽은 페이지는
+   로드된 상태로 두되 처음 접근할 때까지 매핑하지 않고, 스왑 사본을
+   유지해서 쓰이지 않으면 쓰기 없이 다시 쫓아낼 수 있게 한다. */
+void page_swap_in(struct page_table_entry *pte, void *frame) {
+  struct thread *t = thread_current();
+  struct page_table_entry *ptes[SWAP_CLUSTER];
+  void *frames[SWAP_CLUSTER];
+  size_t cnt = 1;
+
+  ptes[0] = pte;
+  frames[0] = frame;
+  while (cnt < SWAP_CLUSTER) {
+    void *upage = pte->upage + cnt * PGSIZE;
+    struct page_table_entry *next;
+
+    if (!is_user_vaddr(upage)) {
+      break;
+    }
+    next = spt_find(&t->spt, upage);
+    if (next == NULL || next->is_loaded || next->type != PAGE_SWAP
+        || next->swap_slot != pte->swap_slot + cnt) {
+      break;
+    }
+    frames[cnt] = try_get_frame(upage);
+    if (frames[cnt] == NULL) {
+      break;
+    }
+    ptes[cnt++] = next;
+  }
+
+  if (cnt == 1) {
+    swap_in(pte->swap_slot, frame);
+  } else {
+    swap_read_cluster(pte->swap_slot, frames, cnt);
+    swap_free(pte->swap_slot);
+  }
+  pte->swap_slot = 0;
+  pte->type = pte->original_type;
+
+  for (size_t i = 1; i < cnt; i++) {
+    ptes[i]->type = ptes[i]->original_type;
+    ptes[i]->kpage = frames[i];
+    ptes[i]->is_loaded = true;
+    ptes[i]->readahead = true;
+    frame_unpin(frames[i]);
+  }
+}
+
+/* 파일에서 막 읽어 매핑한 PTE와 같은 영역에서, PTE가 든 fault_around_pages
+   크기의 정렬된 창 안의 아직 읽지 않은 페이지를 미리 읽어 매핑한다.
+   순서대로 훑는 프로세스가 페이지마다 폴트를 내지 않게 하려는 것이다.
+   빈 프레임이 넉넉할 때만 하며, 쓰기 불가능한 코드 영역은 share.c가
+   프로세스 사이에서 나누므로 건너뛴다. 파일 내용이 끝난 뒤의 0 페이지도
+   읽을 것이 없으므로 건너뛴다. */
+void page_fault_around(struct page_table_entry *pte) {
+  struct thread *t = thread_current();
+  struct vma *vma = vma_find(&t->vmas, pte->upage);
+  uintptr_t first_pg, pg;
+  void *start, *end;
+
+  if (fault_around_pages <= 1 || vma == NULL || vma->file == NULL
+      || (vma->type == PAGE_BINARY && !vma->writable)) {
+    return;
+  }
+  first_pg = pg_no(pte->upage) / fault_around_pages * fault_around_pages;
+  start = (void *) (first_pg << PGBITS);
+  end = start + fault_around_pages * PGSIZE;
+  if (start < vma->start) {
+    start = vma->start;
+  }
+  if (end > vma->start + ROUND_UP(vma->read_bytes, PGSIZE)) {
+    end = vma->start + ROUND_UP(vma->read_bytes, PGSIZE);
+  }
+
+  for (pg = pg_no(start); pg < pg_no(end); pg++) {
+    void *upage = (void *) (pg << PGBITS);
+    struct page_table_entry *next;
+    void *frame;
+
+    if (upage == pte->upage) {
+      continue;
+    }
+    next = spt_find(&t->spt, upage);
+    if (next != NULL && (next->is_loaded || next->type != vma->type)) {
+      continue;
+    }
+    // mmap 페이지는 다른 프로세스가 이미 읽어 둔 프레임이 있으면 그것을 쓴다
+    if (vma->type == PAGE_MMAP) {
+      if (next == NULL) {
+        next = spt_get_page(t, upage);
+      }
+      if (next == NULL || !share_map_file(next, true)) {
+        break;
+      }
+      continue;
+    }
+    frame = frame_get_prefetch(upage);
+    if (frame == NULL) {
+      break;
+    }
+    if (next == NULL) {
+      next = spt_get_page(t, upage);
+    }
+    if (next == NULL
+        || file_read_at(next->file, frame, next->read_bytes,
+                        next->file_offset) != (off_t) next->read_bytes) {
+      free_frame(frame);
+      break;
+    }
+    memset(frame + next->read_bytes, 0, next->zero_bytes);
+    if (!pagedir_set_page(t->pagedir, upage, frame, next->writable)) {
+      free_frame(frame);
+      break;
+    }
+    next->kpage = frame;
+    next->is_loaded = true;
+    frame_set_prefetched(frame);
+  }
+}
@@ -2,12 +2,16 @@
 #define VM_PAGE_H
 
 #include <hash.h>
+#include <list.h>
 #include <stdlib.h>
 #include "filesys/filesys.h"
 #include "threads/vaddr.h"
 
 typedef int mapid_t;
 
+struct shared_page;
+struct thread;
+
 enum page_type {
   PAGE_BINARY,
   PAGE_SWAP,
@@ -33,18 +37,37 @@ struct page_table_entry {
   bool writable;
 
   size_t swap_slot;
+  bool readahead;       // 미리 읽었지만 아직 pagedir에 매핑하지 않은 페이지
+  struct shared_page *shared;   // 코드 페이지나 mmap 페이지 캐시 (share.c)
+  bool cow;             // fork() 후 읽기 전용으로 함께 쓰는 프레임 (frame.c)
+  struct thread *map_thread;    // cow나 mmap 페이지일 때 이 PTE를 가진 스레드
+  struct list_elem map_elem;    // 그때 프레임의 map_ptes 원소
 
   mapid_t mapid;
 };
 
 
+/* -fault-around=N: 파일 페이지 폴트 때 함께 읽어 매핑할 페이지 창의
+   크기. 1 이하이면 끈다. */
+#define FAULT_AROUND_DEFAULT 8
+extern int fault_around_pages;
+
+void page_init(void);
+struct page_table_entry *pte_alloc(void);
+void pte_free(struct page_table_entry *pte);
+
 void spt_init(struct hash *spt);
 bool spt_insert(struct hash *spt, struct page_table_entry *pte);
 struct page_table_entry *spt_create_page(struct hash *spt, void *upage);
+struct page_table_entry *spt_get_page(struct thread *t, void *upage);
 struct page_table_entry *spt_find(struct hash *spt, void *upage);
+struct page_table_entry *spt_lookup(struct thread *t, void *upage);
 void spt_remove_page(struct hash *spt, void *upage);
 void spt_remove(struct hash *spt, struct page_table_entry *pte);
 void spt_destroy(struct hash *spt);
+bool spt_fork(struct thread *parent);
+void page_swap_in(struct page_table_entry *pte, void *frame);
+void page_fault_around(struct page_table_entry *pte);
 
 unsigned page_hash(const struct hash_elem *e, void *aux UNUSED);
 bool page_less(const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED);
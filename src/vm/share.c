@@ -0,0 +1,365 @@
+#include "vm/share.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+
+/* 같은 실행 파일을 실행하는 프로세스들이 쓰기 불가능한 코드 페이지의
+   프레임을 함께 쓴다. 페이지는 (inode, 파일 오프셋, 읽을 바이트 수,
+   읽을 때의 inode 쓰기 횟수)로 찾는다. 쓰기 횟수가 키에 들어가므로 파일이
+   바뀌면 옛 페이지는 다시 찾아지지 않는다.
+
+   mmap한 파일 페이지도 같은 표에서 (inode, 파일 오프셋)으로 찾아 그
+   파일을 매핑한 모든 프로세스가 한 프레임을 쓴다. 그래서 한 프로세스가
+   쓴 내용을 다른 프로세스가 바로 본다. 매핑마다 읽을 바이트 수가 다르면
+   (매핑 사이에 파일이 늘어난 경우) read_bytes는 그 중 가장 큰 값이다.
+
+   두 페이지 모두 프레임을 고정하지 않는다. frame.c가 매핑한 PTE들을
+   기억해 쫓아낼 때 모든 매핑을 없애고, mmap 페이지가 바뀌었으면 파일에
+   한 번 쓴다. 코드 페이지는 읽기 전용으로 매핑되므로 쓰지 않고 버린다.
+   ref_cnt는 이 페이지를 가리키는 PTE 수이고, 쫓겨난 동안에도 PTE는
+   페이지를 가리키므로 다시 폴트가 나면 같은 페이지를 채운다. 프레임을
+   채우거나 매핑하거나 mmap 페이지의 마지막 PTE를 놓는 동안에는
+   load_lock을 잡는다.
+
+   mmap 페이지는 마지막 PTE가 놓으면 바로 파일에 쓰고 버린다. 코드
+   페이지는 다음 exec가 디스크를 읽지 않도록 남겨 두되 unused_list에
+   오래된 순으로 올려 둔다. 빈 프레임이 없으면 frame_alloc()이 다른
+   페이지를 쫓아내기 전에 share_reclaim()으로 먼저 회수하고, 그 전에
+   page cleaner나 eviction이 프레임만 가져갈 수도 있다. 실행 파일을 지우면
+   share_forget_removed()가 그 파일의 남은 페이지를 버려 inode를 닫으므로
+   파일의 블록이 해제된다. 아직 실행 중인 파일이면 마지막 PTE가 놓을 때
+   남겨 두지 않고 버린다.
+
+   load_lock, share_lock, frame_lock 순서로 잡는다. share_lock을 잡은 채로
+   get_frame()을 부르거나 파일에 쓰지는 않는다. */
+
+static struct hash shared_pages;
+static struct list unused_list;
+static struct lock share_lock;
+static struct slab_cache *shared_page_cache;
+
+static unsigned long long hit_cnt;      /* 이미 있던 프레임을 매핑한 수 */
+static unsigned long long miss_cnt;     /* 파일에서 읽은 수 */
+static unsigned long long reclaim_cnt;  /* 버린 unused_list의 페이지 수 */
+static unsigned long long file_hit_cnt;   /* 다른 매핑의 프레임을 쓴 수 */
+static unsigned long long file_miss_cnt;  /* mmap 페이지를 파일에서 읽은 수 */
+
+static unsigned shared_page_hash(const struct hash_elem *e, void *aux UNUSED);
+static bool shared_page_less(const struct hash_elem *a,
+                             const struct hash_elem *b, void *aux UNUSED);
+static struct shared_page *share_lookup(const struct page_table_entry *pte,
+                                        bool mmap);
+static bool share_load(struct page_table_entry *pte, bool prefetch);
+static void share_free(struct shared_page *sp);
+
+void share_init(void) {
+  hash_init(&shared_pages, shared_page_hash, shared_page_less, NULL);
+  list_init(&unused_list);
+  lock_init(&share_lock);
+  shared_page_cache = slab_cache_create("shared page",
+                                        sizeof(struct shared_page), NULL);
+}
+
+void share_print_stats(void) {
+  printf("Shared text: %llu hits, %llu reads, %llu pages reclaimed\n",
+         hit_cnt, miss_cnt, reclaim_cnt);
+  printf("Shared mmap: %llu hits, %llu reads\n", file_hit_cnt, file_miss_cnt);
+}
+
+static unsigned shared_page_hash(const struct hash_elem *e, void *aux UNUSED) {
+  const struct shared_page *sp = hash_entry(e, struct shared_page, elem);
+  unsigned h = hash_bytes(&sp->inode, sizeof sp->inode);
+
+  h = h * 31 + hash_int(sp->offset);
+  h = h * 31 + hash_int(sp->mmap);
+  if (sp->mmap)
+    return h;
+  h = h * 31 + hash_int(sp->read_bytes);
+  return h * 31 + hash_int(sp->write_cnt);
+}
+
+static bool shared_page_less(const struct hash_elem *a_,
+                             const struct hash_elem *b_, void *aux UNUSED) {
+  const struct shared_page *a = hash_entry(a_, struct shared_page, elem);
+  const struct shared_page *b = hash_entry(b_, struct shared_page, elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->offset != b->offset)
+    return a->offset < b->offset;
+  if (a->mmap != b->mmap)
+    return a->mmap < b->mmap;
+  if (a->mmap)
+    return false;
+  if (a->read_bytes != b->read_bytes)
+    return a->read_bytes < b->read_bytes;
+  return a->write_cnt < b->write_cnt;
+}
+
+// 공유할 수 있는 페이지인가: 파일에서 읽는 쓰기 불가능한 실행 파일 페이지
+bool share_is_shareable(const struct page_table_entry *pte) {
+  return pte->type == PAGE_BINARY && !pte->writable
+         && pte->file != NULL && pte->read_bytes > 0;
+}
+
+/* PTE의 내용을 가진 공유 페이지를 찾는다. mmap 페이지는 파일이 바뀌어도
+   같은 페이지이므로 (inode, 오프셋)만 본다. share_lock을 잡고 호출. */
+static struct shared_page *share_lookup(const struct page_table_entry *pte,
+                                        bool mmap) {
+  struct shared_page key;
+  struct hash_elem *e;
+
+  key.inode = file_get_inode(pte->file);
+  key.offset = pte->file_offset;
+  key.read_bytes = pte->read_bytes;
+  key.mmap = mmap;
+  key.write_cnt = mmap ? 0 : inode_write_cnt(key.inode);
+  e = hash_find(&shared_pages, &key.elem);
+  return e != NULL ? hash_entry(e, struct shared_page, elem) : NULL;
+}
+
+/* PTE의 내용을 가진 공유 페이지를 찾아, 없으면 만들어서 PTE가 가리키게
+   한다. 메모리가 없으면 false. */
+static bool share_get(struct page_table_entry *pte, bool mmap) {
+  struct shared_page *sp;
+
+  lock_acquire(&share_lock);
+  sp = share_lookup(pte, mmap);
+  if (sp == NULL) {
+    sp = slab_alloc(shared_page_cache);
+    if (sp == NULL) {
+      lock_release(&share_lock);
+      return false;
+    }
+    sp->inode = inode_reopen(file_get_inode(pte->file));
+    sp->offset = pte->file_offset;
+    sp->read_bytes = pte->read_bytes;
+    sp->write_cnt = mmap ? 0 : inode_write_cnt(sp->inode);
+    sp->mmap = mmap;
+    sp->kpage = NULL;
+    sp->ref_cnt = 0;
+    lock_init(&sp->load_lock);
+    hash_insert(&shared_pages, &sp->elem);
+  } else if (sp->ref_cnt == 0 && !mmap) {
+    list_remove(&sp->lru_elem);
+  }
+  sp->ref_cnt++;
+  pte->shared = sp;
+  lock_release(&share_lock);
+  return true;
+}
+
+/* 쓰기 불가능한 실행 파일 페이지 PTE를 다른 프로세스와 함께 쓰는 프레임에
+   매핑한다. 아직 메모리에 없으면 파일에서 읽는다. */
+bool share_map(struct page_table_entry *pte) {
+  ASSERT(share_is_shareable(pte) && !pte->is_loaded);
+
+  if (pte->shared == NULL && !share_get(pte, false)) {
+    return false;
+  }
+  return share_load(pte, false);
+}
+
+/* mmap한 파일 페이지 PTE를 그 파일 페이지의 프레임에 매핑한다. 아직
+   메모리에 없으면 파일에서 읽는다. PREFETCH이면 (fault-around) 빈 프레임이
+   넉넉할 때만 읽고, 다른 스레드가 읽고 있으면 기다리지 않고 false를
+   반환한다. */
+bool share_map_file(struct page_table_entry *pte, bool prefetch) {
+  ASSERT(pte->type == PAGE_MMAP && !pte->is_loaded);
+
+  if (pte->shared == NULL && !share_get(pte, true)) {
+    return false;
+  }
+  return share_load(pte, prefetch);
+}
+
+/* PTE를 그것이 가리키는 공유 페이지의 프레임에 매핑한다. 프레임이 없으면
+   새로 받아 파일에서 읽는다. */
+static bool share_load(struct page_table_entry *pte, bool prefetch) {
+  struct shared_page *sp = pte->shared;
+  void *frame;
+  bool success = true;
+  bool hit = false;
+
+  if (prefetch) {
+    if (!lock_try_acquire(&sp->load_lock))
+      return false;
+  } else {
+    lock_acquire(&sp->load_lock);
+  }
+  if (pte->read_bytes > sp->read_bytes) {
+    // 파일이 늘어난 뒤에 매핑했다. 메모리에 있는 프레임에 늘어난 부분을 읽는다
+    ASSERT(sp->mmap);
+    frame = frame_file_pin(sp);
+    if (frame != NULL) {
+      inode_read_at(sp->inode, frame + sp->read_bytes,
+                    pte->read_bytes - sp->read_bytes,
+                    sp->offset + sp->read_bytes);
+      frame_unpin(frame);
+    }
+    sp->read_bytes = pte->read_bytes;
+  }
+  if (frame_file_map(sp, pte)) {
+    hit = true;
+  } else {
+    frame = prefetch ? frame_get_prefetch(pte->upage)
+                     : get_frame(PAL_USER, pte->upage);
+    if (frame == NULL) {
+      success = false;
+    } else if (inode_read_at(sp->inode, frame, sp->read_bytes, sp->offset)
+               != (off_t) sp->read_bytes) {
+      free_frame(frame);
+      success = false;
+    } else {
+      memset(frame + sp->read_bytes, 0, PGSIZE - sp->read_bytes);
+      frame_file_install(sp, frame, pte, prefetch);
+    }
+  }
+  lock_release(&sp->load_lock);
+
+  if (success) {
+    lock_acquire(&share_lock);
+    if (sp->mmap && hit)
+      file_hit_cnt++;
+    else if (sp->mmap)
+      file_miss_cnt++;
+    else if (hit)
+      hit_cnt++;
+    else
+      miss_cnt++;
+    lock_release(&share_lock);
+  }
+  return success && pte->is_loaded;
+}
+
+/* 현재 프로세스의 mmap 페이지 PTE를 파일 페이지에서 뗀다. 마지막
+   PTE였으면 바뀐 내용을 파일에 쓰고 페이지를 버린다. */
+static void share_unmap_file(struct page_table_entry *pte) {
+  struct shared_page *sp = pte->shared;
+  bool last;
+
+  frame_file_unmap(pte);
+  pte->shared = NULL;
+
+  // 쓰는 동안 다른 프로세스가 이 페이지를 찾아 파일의 옛 내용을 읽지
+  // 않도록 load_lock을 잡고 쓴다. 그 사이에 새로 매핑하려는 프로세스가
+  // 생기면 페이지를 남겨 둔다.
+  lock_acquire(&sp->load_lock);
+  lock_acquire(&share_lock);
+  ASSERT(sp->ref_cnt > 0);
+  last = --sp->ref_cnt == 0;
+  lock_release(&share_lock);
+  if (last) {
+    frame_file_release(sp);
+
+    lock_acquire(&share_lock);
+    last = sp->ref_cnt == 0;
+    if (last)
+      hash_delete(&shared_pages, &sp->elem);
+    lock_release(&share_lock);
+  }
+  lock_release(&sp->load_lock);
+
+  if (last) {
+    inode_close(sp->inode);
+    slab_free(shared_page_cache, sp);
+  }
+}
+
+/* 현재 프로세스에서 공유 페이지 PTE의 매핑을 없앤다. 마지막 PTE였으면
+   코드 페이지는 unused_list의 맨 뒤에 두고, 그 사이에 실행 파일이
+   지워졌으면 버린다. */
+void share_unmap(struct page_table_entry *pte) {
+  struct shared_page *sp = pte->shared;
+  bool removed = false;
+
+  ASSERT(sp != NULL);
+
+  if (sp->mmap) {
+    share_unmap_file(pte);
+    return;
+  }
+
+  frame_file_unmap(pte);
+  pte->shared = NULL;
+
+  lock_acquire(&share_lock);
+  ASSERT(sp->ref_cnt > 0);
+  if (--sp->ref_cnt == 0) {
+    removed = inode_is_removed(sp->inode);
+    if (removed)
+      hash_delete(&shared_pages, &sp->elem);
+    else
+      list_push_back(&unused_list, &sp->lru_elem);
+  }
+  lock_release(&share_lock);
+
+  if (removed)
+    share_free(sp);
+}
+
+/* 아무도 가리키지 않는 코드 페이지 SP를 버린다. 프레임이 남아 있으면
+   유저 풀에 돌려주고 inode를 닫는다. 표와 unused_list에서 이미 뺀 뒤에
+   share_lock 없이 호출. */
+static void share_free(struct shared_page *sp) {
+  lock_acquire(&sp->load_lock);
+  frame_file_release(sp);
+  lock_release(&sp->load_lock);
+  inode_close(sp->inode);
+  slab_free(shared_page_cache, sp);
+}
+
+/* 아무도 매핑하지 않은 코드 페이지 가운데 가장 오래된 것을 버린다. 프레임이
+   남아 있었으면 유저 풀에 돌아간다. 버린 페이지가 없으면 false. */
+bool share_reclaim(void) {
+  struct shared_page *sp;
+
+  lock_acquire(&share_lock);
+  if (list_empty(&unused_list)) {
+    lock_release(&share_lock);
+    return false;
+  }
+  sp = list_entry(list_pop_front(&unused_list), struct shared_page, lru_elem);
+  hash_delete(&shared_pages, &sp->elem);
+  reclaim_cnt++;
+  lock_release(&share_lock);
+
+  share_free(sp);
+  return true;
+}
+
+/* 아무도 매핑하지 않은 코드 페이지 가운데 실행 파일이 지워진 것을 모두
+   버린다. 남겨 두면 inode가 열린 채라 파일의 블록이 해제되지 않는다.
+   파일을 지운 뒤에 불린다. */
+void share_forget_removed(void) {
+  struct list removed;
+  struct list_elem *e;
+
+  list_init(&removed);
+  lock_acquire(&share_lock);
+  for (e = list_begin(&unused_list); e != list_end(&unused_list);) {
+    struct shared_page *sp = list_entry(e, struct shared_page, lru_elem);
+
+    e = list_next(e);
+    if (inode_is_removed(sp->inode)) {
+      list_remove(&sp->lru_elem);
+      hash_delete(&shared_pages, &sp->elem);
+      list_push_back(&removed, &sp->lru_elem);
+    }
+  }
+  lock_release(&share_lock);
+
+  while (!list_empty(&removed)) {
+    share_free(list_entry(list_pop_front(&removed), struct shared_page,
+                          lru_elem));
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+#include "vm/page.h"
+
+/* 여러 프로세스가 함께 쓰는 파일 페이지. 쓰기 불가능한 실행 파일 페이지와
+   mmap한 파일 페이지가 있다 (share.c). */
+struct shared_page {
+  struct inode *inode;          /* 페이지가 있는 동안 열어 둔다 */
+  off_t offset;
+  uint32_t read_bytes;          /* mmap이면 매핑들 중 가장 큰 값 */
+  unsigned write_cnt;           /* 읽을 때의 inode_write_cnt(), mmap이면 0 */
+  bool mmap;                    /* mmap한 파일 페이지인가 */
+
+  void *kpage;                  /* frame_lock이 지키고, 쫓겨나면 NULL */
+  int ref_cnt;                  /* 이 페이지를 가리키는 PTE 수 */
+  struct lock load_lock;        /* 채우거나 매핑하거나 놓는 동안 */
+
+  struct hash_elem elem;        /* shared_pages의 원소 */
+  struct list_elem lru_elem;    /* ref_cnt가 0이면 unused_list의 원소 */
+};
+
+void share_init(void);
+bool share_is_shareable(const struct page_table_entry *pte);
+bool share_map(struct page_table_entry *pte);
+bool share_map_file(struct page_table_entry *pte, bool prefetch);
+void share_unmap(struct page_table_entry *pte);
+bool share_reclaim(void);
+void share_forget_removed(void);
+void share_print_stats(void);
+
+#endif /* vm/share.h */
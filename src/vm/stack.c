@@ -58,6 +58,7 @@ bool grow_stack(void *upage) {
   
   pte->kpage = frame;
   pte->is_loaded = true;
+  frame_unpin(frame);
   
   return true;
 }
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include "vm/swap.h"
 #include <bitmap.h>
 #include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "devices/block.h"
@@ -10,13 +13,65 @@
 
 static struct swap_table swap_table;
 
+// 통계
+static unsigned long long out_page_cnt;   /* 쓴 페이지 수 */
+static unsigned long long out_req_cnt;    /* 쓰기 요청 수 */
+static unsigned long long in_page_cnt;    /* 읽은 페이지 수 */
+static unsigned long long in_req_cnt;     /* 읽기 요청 수 */
+static unsigned long long readahead_cnt;  /* 미리 읽은 페이지 수 */
+static unsigned long long readahead_hit_cnt; /* 그 중 실제로 쓰인 수 */
+static unsigned io_cnt;                   /* 진행 중인 전송 수 */
+static unsigned max_io_cnt;               /* 동시에 진행된 최대 전송 수 */
+
 void swap_init(void) {
   swap_table.swap_block = block_get_role(BLOCK_SWAP);
   block_sector_t swap_sectors = block_size(swap_table.swap_block);
   swap_table.swap_size = swap_sectors / SECTORS_PER_PAGE;
   swap_table.swap_bitmap = bitmap_create(swap_table.swap_size);
   bitmap_set_all(swap_table.swap_bitmap, false);
+  // 모든 변경이 swap_lock 아래에서 일어나므로 summary를 쓸 수 있다
+  bitmap_add_summary(swap_table.swap_bitmap);
   lock_init(&swap_table.swap_lock);
+  lock_init(&swap_table.cluster_lock);
+  swap_table.cluster_buf = palloc_get_multiple(PAL_ASSERT, SWAP_CLUSTER);
+  swap_table.share_cnt = calloc(swap_table.swap_size,
+                                sizeof *swap_table.share_cnt);
+  if (swap_table.share_cnt == NULL && swap_table.swap_size > 0)
+    PANIC("swap_init: cannot allocate share counts");
+}
+
+/* swap_lock은 슬롯 비트맵과 통계만 보호한다. 데이터 전송은 락 밖에서
+   하므로 여러 프로세스의 스왑 I/O가 동시에 진행될 수 있다. 전송 중인
+   슬롯은 비트맵에서 사용 중으로 남아 있어 다른 스레드가 가져가지
+   못한다. */
+
+/* 스왑 디스크로의 전송 하나를 시작하고 끝낼 때 부른다. 동시에 몇 개가
+   진행되었는지 센다. */
+static void swap_io_begin(void) {
+  lock_acquire(&swap_table.swap_lock);
+  if (++io_cnt > max_io_cnt)
+    max_io_cnt = io_cnt;
+  lock_release(&swap_table.swap_lock);
+}
+
+static void swap_io_end(void) {
+  lock_acquire(&swap_table.swap_lock);
+  io_cnt--;
+  lock_release(&swap_table.swap_lock);
+}
+
+// 빈 슬롯 CNT개를 연속으로 잡는다. 슬롯 0은 예약.
+static size_t swap_alloc(size_t cnt) {
+  size_t slot;
+
+  lock_acquire(&swap_table.swap_lock);
+  slot = bitmap_scan_and_flip(swap_table.swap_bitmap, 1, cnt, false);
+  if (slot != BITMAP_ERROR) {
+    out_page_cnt += cnt;
+    out_req_cnt++;
+  }
+  lock_release(&swap_table.swap_lock);
+  return slot;
 }
 
 size_t swap_out(void *frame) {
@@ -27,20 +82,45 @@ size_t swap_out(void *frame) {
     return BITMAP_ERROR;
   }
   
-  lock_acquire(&swap_table.swap_lock);
-  
-  // 빈 swap 슬롯 찾기, 0 대신 1부터 스캔 시작 (슬롯 0을 예약)
-  size_t slot = bitmap_scan_and_flip(swap_table.swap_bitmap, 1, 1, false);
-
-  block_sector_t sector = slot * SECTORS_PER_PAGE;
-  // 페이지를 섹터 단위로 swap 디스크에 쓰기
-  for (int i = 0; i < SECTORS_PER_PAGE; i++) {
-    block_write(swap_table.swap_block, 
-                sector + i,
-                frame + (i * BLOCK_SECTOR_SIZE));
+  size_t slot = swap_alloc(1);
+  if (slot == BITMAP_ERROR) {
+    return BITMAP_ERROR;
   }
-  
-  lock_release(&swap_table.swap_lock);
+
+  // 페이지 전체를 한 번의 요청으로 swap 디스크에 쓰기
+  swap_io_begin();
+  block_write_multiple(swap_table.swap_block, slot * SECTORS_PER_PAGE,
+                       SECTORS_PER_PAGE, frame);
+  swap_io_end();
+  return slot;
+}
+
+/* FRAMES[0..CNT)을 연속된 CNT개의 슬롯에 한 번의 요청으로 쓰고 첫 슬롯을
+   반환한다. FRAMES[i]는 (첫 슬롯 + i)에 들어간다. 연속된 빈 슬롯이
+   없으면 BITMAP_ERROR. bounce buffer는 하나뿐이라 cluster_lock으로
+   보호하지만 한 페이지짜리 I/O는 막지 않는다. */
+size_t swap_out_cluster(void *frames[], size_t cnt) {
+  ASSERT(cnt > 0 && cnt <= SWAP_CLUSTER);
+
+  if (swap_table.swap_bitmap == NULL || swap_table.swap_block == NULL) {
+    return BITMAP_ERROR;
+  }
+
+  size_t slot = swap_alloc(cnt);
+  if (slot == BITMAP_ERROR) {
+    return BITMAP_ERROR;
+  }
+
+  // 흩어진 프레임을 bounce buffer에 모아 한 번에 쓴다
+  lock_acquire(&swap_table.cluster_lock);
+  swap_io_begin();
+  for (size_t i = 0; i < cnt; i++) {
+    memcpy(swap_table.cluster_buf + i * PGSIZE, frames[i], PGSIZE);
+  }
+  block_write_multiple(swap_table.swap_block, slot * SECTORS_PER_PAGE,
+                       cnt * SECTORS_PER_PAGE, swap_table.cluster_buf);
+  swap_io_end();
+  lock_release(&swap_table.cluster_lock);
   return slot;
 }
 
@@ -56,18 +136,67 @@ void swap_in(size_t slot, void *frame) {
     lock_release(&swap_table.swap_lock);
     return;
   }
+  in_page_cnt++;
+  in_req_cnt++;
+  lock_release(&swap_table.swap_lock);
   
-  block_sector_t sector = slot * SECTORS_PER_PAGE;
+  // swap 디스크에서 페이지 전체를 한 번의 요청으로 읽기
+  swap_io_begin();
+  block_read_multiple(swap_table.swap_block, slot * SECTORS_PER_PAGE,
+                      SECTORS_PER_PAGE, frame);
+  swap_io_end();
   
-  // swap 디스크에서 페이지 읽기
-  for (int i = 0; i < SECTORS_PER_PAGE; i++) {
-    block_read(swap_table.swap_block,
-               sector + i, 
-               frame + (i * BLOCK_SECTOR_SIZE));
+  // 다 읽은 뒤에야 슬롯을 놓아 준다
+  swap_free(slot);
+}
+
+/* 슬롯 SLOT부터 연속된 CNT개의 슬롯을 한 번의 요청으로 읽어 FRAMES[i]에
+   (SLOT + i)의 내용을 채운다. 슬롯은 해제하지 않는다. FRAMES[0]은
+   폴트난 페이지이고 나머지는 미리 읽은 페이지로 센다. */
+void swap_read_cluster(size_t slot, void *frames[], size_t cnt) {
+  ASSERT(cnt > 0 && cnt <= SWAP_CLUSTER);
+  ASSERT(slot + cnt <= swap_table.swap_size);
+
+  lock_acquire(&swap_table.cluster_lock);
+  swap_io_begin();
+  block_read_multiple(swap_table.swap_block, slot * SECTORS_PER_PAGE,
+                      cnt * SECTORS_PER_PAGE, swap_table.cluster_buf);
+  for (size_t i = 0; i < cnt; i++) {
+    memcpy(frames[i], swap_table.cluster_buf + i * PGSIZE, PGSIZE);
   }
-  
-  bitmap_set(swap_table.swap_bitmap, slot, false);
-  
+  swap_io_end();
+  lock_release(&swap_table.cluster_lock);
+
+  lock_acquire(&swap_table.swap_lock);
+  in_page_cnt += cnt;
+  in_req_cnt++;
+  readahead_cnt += cnt - 1;
+  lock_release(&swap_table.swap_lock);
+}
+
+// 미리 읽은 페이지에 처음 접근했을 때 불린다
+void swap_count_readahead_hit(void) {
+  lock_acquire(&swap_table.swap_lock);
+  readahead_hit_cnt++;
+  lock_release(&swap_table.swap_lock);
+}
+
+void swap_print_stats(void) {
+  printf("Swap: %llu pages out in %llu writes, %llu pages in in %llu reads, "
+         "%llu of %llu readahead pages used, "
+         "at most %u transfers in flight\n",
+         out_page_cnt, out_req_cnt, in_page_cnt, in_req_cnt,
+         readahead_hit_cnt, readahead_cnt, max_io_cnt);
+}
+
+/* fork()한 자식의 PTE도 SLOT을 가리키게 되었다. 슬롯은 마지막
+   swap_free()에서야 비워진다. */
+void swap_share(size_t slot) {
+  ASSERT(slot < swap_table.swap_size);
+  lock_acquire(&swap_table.swap_lock);
+  ASSERT(bitmap_test(swap_table.swap_bitmap, slot));
+  ASSERT(swap_table.share_cnt[slot] < UINT16_MAX);
+  swap_table.share_cnt[slot]++;
   lock_release(&swap_table.swap_lock);
 }
 
@@ -78,6 +207,12 @@ void swap_free(size_t slot) {
     lock_release(&swap_table.swap_lock);
     return;
   }
+  // 다른 PTE가 아직 가리키고 있으면 사본을 남겨 둔다
+  if (swap_table.share_cnt[slot] > 0) {
+    swap_table.share_cnt[slot]--;
+    lock_release(&swap_table.swap_lock);
+    return;
+  }
   bitmap_set(swap_table.swap_bitmap, slot, false);
   lock_release(&swap_table.swap_lock);
 }
@@ -2,20 +2,32 @@
 #define VM_SWAP_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <bitmap.h>
 #include "threads/synch.h"
 #include "devices/block.h"
 
+/* 한 번에 연속된 슬롯으로 쓰거나 미리 읽는 최대 페이지 수 */
+#define SWAP_CLUSTER 8
+
 struct swap_table {
   struct block *swap_block;
   struct bitmap *swap_bitmap;
   struct lock swap_lock;
   size_t swap_size;
+  struct lock cluster_lock;     /* cluster_buf 보호 */
+  void *cluster_buf;            /* SWAP_CLUSTER 페이지짜리 bounce buffer */
+  uint16_t *share_cnt;          /* 슬롯마다 함께 쓰는 추가 PTE 수 (fork) */
 };
 
 void swap_init(void);
 size_t swap_out(void *frame);
+size_t swap_out_cluster(void *frames[], size_t cnt);
 void swap_in(size_t slot, void *frame);
+void swap_read_cluster(size_t slot, void *frames[], size_t cnt);
+void swap_share(size_t slot);
 void swap_free(size_t slot);
+void swap_count_readahead_hit(void);
+void swap_print_stats(void);
 
-#endif /* vm/swap.h */
\ No newline at end of file
+#endif /* vm/swap.h */
@@ -0,0 +1,201 @@
+#include "vm/vma.h"
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/vaddr.h"
+#include "filesys/file.h"
+
+/* 실행 파일의 세그먼트와 mmap은 페이지마다 PTE를 미리 만들지 않고 영역
+   하나로 기록한다. 영역을 만들고 지우는 비용은 페이지 수가 아니라 영역
+   수에 비례하고, PTE는 처음 폴트난 페이지에만 생긴다.
+
+   영역은 서로 겹치지 않으므로 시작 주소로 정렬하면 끝 주소도 정렬된다.
+   그래서 정렬된 배열에서 끝 주소로 이분 탐색하면 주소가 속한 영역과
+   겹치는 영역을 모두 찾을 수 있다. 프로세스의 영역은 보통 몇 개뿐이라
+   넣고 뺄 때 배열을 미는 비용은 문제되지 않는다.
+
+   영역은 자기 파일을 따로 열어 두고, 영역에서 만든 PTE는 그 파일을
+   빌려 쓴다. 따라서 영역은 그 안의 PTE보다 나중에 지워야 한다. */
+
+#define VMA_INIT_CAP 8
+
+static struct slab_cache *vma_cache;
+
+static size_t vma_lower_bound(const struct vma_table *vt, const void *addr);
+static bool vma_table_insert(struct vma_table *vt, struct vma *vma);
+
+void vma_init(void) {
+  vma_cache = slab_cache_create("vma", sizeof(struct vma), NULL);
+}
+
+void vma_table_init(struct vma_table *vt) {
+  vt->vmas = NULL;
+  vt->cnt = 0;
+  vt->cap = 0;
+}
+
+/* START부터 LENGTH 바이트(페이지 단위로 올림)의 영역을 VT에 넣는다.
+   START에 해당하는 파일 오프셋은 OFFSET이고, 앞의 READ_BYTES 바이트는
+   FILE에서 읽고 나머지는 0으로 채운다. 성공하면 FILE은 영역의 것이 된다.
+   다른 영역과 겹치거나 메모리가 없으면 NULL을 돌려준다. */
+struct vma *vma_create(struct vma_table *vt, void *start, size_t length,
+                       struct file *file, off_t offset, uint32_t read_bytes,
+                       bool writable) {
+  ASSERT(pg_ofs(start) == 0);
+  ASSERT(length > 0);
+
+  struct vma *vma = slab_alloc(vma_cache);
+  if (vma == NULL) {
+    return NULL;
+  }
+  vma->start = start;
+  vma->end = start + ROUND_UP(length, PGSIZE);
+  vma->type = PAGE_BINARY;
+  vma->file = file;
+  vma->offset = offset;
+  vma->read_bytes = read_bytes;
+  vma->writable = writable;
+  vma->mapid = -1;
+
+  if (!vma_table_insert(vt, vma)) {
+    slab_free(vma_cache, vma);
+    return NULL;
+  }
+  return vma;
+}
+
+/* VMA를 VT에서 빼고 파일을 닫는다. 영역 안의 PTE는 먼저 지워야 한다. */
+void vma_remove(struct vma_table *vt, struct vma *vma) {
+  size_t i = vma_lower_bound(vt, vma->start);
+
+  ASSERT(i < vt->cnt && vt->vmas[i] == vma);
+  memmove(vt->vmas + i, vt->vmas + i + 1,
+          (vt->cnt - i - 1) * sizeof *vt->vmas);
+  vt->cnt--;
+
+  if (vma->file != NULL) {
+    file_close(vma->file);
+  }
+  slab_free(vma_cache, vma);
+}
+
+/* VT의 모든 영역을 지운다. spt_destroy() 다음에 부른다. */
+void vma_destroy(struct vma_table *vt) {
+  for (size_t i = 0; i < vt->cnt; i++) {
+    if (vt->vmas[i]->file != NULL) {
+      file_close(vt->vmas[i]->file);
+    }
+    slab_free(vma_cache, vt->vmas[i]);
+  }
+  free(vt->vmas);
+  vma_table_init(vt);
+}
+
+/* fork()한 자식의 빈 영역 표 DST를 부모의 SRC와 같게 만든다. 파일은
+   새로 연다. 실패해도 이미 넣은 영역은 vma_destroy()로 정리할 수 있다. */
+bool vma_fork(struct vma_table *dst, const struct vma_table *src) {
+  ASSERT(dst->cnt == 0);
+
+  for (size_t i = 0; i < src->cnt; i++) {
+    const struct vma *p = src->vmas[i];
+    struct file *file = NULL;
+    struct vma *c;
+
+    if (p->file != NULL) {
+      file = file_reopen(p->file);
+      if (file == NULL) {
+        return false;
+      }
+    }
+    c = vma_create(dst, p->start, p->end - p->start, file, p->offset,
+                   p->read_bytes, p->writable);
+    if (c == NULL) {
+      if (file != NULL) {
+        file_close(file);
+      }
+      return false;
+    }
+    c->type = p->type;
+    c->mapid = p->mapid;
+  }
+  return true;
+}
+
+/* ADDR이 속한 영역을 돌려준다. 없으면 NULL. */
+struct vma *vma_find(const struct vma_table *vt, const void *addr) {
+  size_t i = vma_lower_bound(vt, addr);
+
+  if (i < vt->cnt && vt->vmas[i]->start <= addr) {
+    return vt->vmas[i];
+  }
+  return NULL;
+}
+
+/* [START, END)와 겹치는 영역이 있으면 true. */
+bool vma_overlaps(const struct vma_table *vt, const void *start,
+                  const void *end) {
+  size_t i = vma_lower_bound(vt, start);
+
+  return i < vt->cnt && vt->vmas[i]->start < end;
+}
+
+/* PTE->upage가 VMA 안의 페이지일 때 그 페이지를 처음 읽어 들이는 데
+   필요한 정보를 PTE에 채운다. PTE의 파일은 VMA의 것을 빌려 쓴다. */
+void vma_fill_page(const struct vma *vma, struct page_table_entry *pte) {
+  uint32_t ofs = pte->upage - vma->start;
+
+  ASSERT(vma->start <= pte->upage && pte->upage < vma->end);
+
+  pte->type = vma->type;
+  pte->original_type = vma->type;
+  pte->writable = vma->writable;
+  pte->file = vma->file;
+  pte->file_offset = vma->offset + ofs;
+  if (vma->read_bytes <= ofs) {
+    pte->read_bytes = 0;
+  } else if (vma->read_bytes - ofs < PGSIZE) {
+    pte->read_bytes = vma->read_bytes - ofs;
+  } else {
+    pte->read_bytes = PGSIZE;
+  }
+  pte->zero_bytes = PGSIZE - pte->read_bytes;
+  pte->mapid = vma->mapid;
+}
+
+/* 끝 주소가 ADDR보다 큰 첫 영역의 위치. */
+static size_t vma_lower_bound(const struct vma_table *vt, const void *addr) {
+  size_t lo = 0, hi = vt->cnt;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (vt->vmas[mid]->end <= addr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static bool vma_table_insert(struct vma_table *vt, struct vma *vma) {
+  size_t i = vma_lower_bound(vt, vma->start);
+
+  if (i < vt->cnt && vt->vmas[i]->start < vma->end) {
+    return false;
+  }
+  if (vt->cnt == vt->cap) {
+    size_t cap = vt->cap == 0 ? VMA_INIT_CAP : vt->cap * 2;
+    struct vma **vmas = realloc(vt->vmas, cap * sizeof *vmas);
+    if (vmas == NULL) {
+      return false;
+    }
+    vt->vmas = vmas;
+    vt->cap = cap;
+  }
+  memmove(vt->vmas + i + 1, vt->vmas + i, (vt->cnt - i) * sizeof *vt->vmas);
+  vt->vmas[i] = vma;
+  vt->cnt++;
+  return true;
+}
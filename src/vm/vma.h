@@ -0,0 +1,43 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "vm/page.h"
+
+/* 가상 주소 공간의 연속된 영역 하나. 실행 파일의 세그먼트나 mmap 하나에
+   해당하며, 영역 안의 PTE는 처음 폴트날 때 spt_get_page()가 만든다. */
+struct vma {
+  void *start;                  /* 첫 페이지 */
+  void *end;                    /* 마지막 페이지 다음 */
+  enum page_type type;          /* PAGE_BINARY 또는 PAGE_MMAP */
+  struct file *file;            /* 영역이 열어 둔 파일, 없으면 NULL */
+  off_t offset;                 /* start에 해당하는 파일 오프셋 */
+  uint32_t read_bytes;          /* start부터 파일에서 읽을 바이트 수 */
+  bool writable;
+  mapid_t mapid;                /* PAGE_MMAP이면 매핑 번호 */
+};
+
+/* 프로세스의 영역들. 시작 주소 순으로 정렬된 배열이라 주소로 찾거나
+   겹치는지 보는 데 O(log n)이다. */
+struct vma_table {
+  struct vma **vmas;
+  size_t cnt;
+  size_t cap;
+};
+
+void vma_init(void);
+void vma_table_init(struct vma_table *vt);
+struct vma *vma_create(struct vma_table *vt, void *start, size_t length,
+                       struct file *file, off_t offset, uint32_t read_bytes,
+                       bool writable);
+void vma_remove(struct vma_table *vt, struct vma *vma);
+void vma_destroy(struct vma_table *vt);
+bool vma_fork(struct vma_table *dst, const struct vma_table *src);
+struct vma *vma_find(const struct vma_table *vt, const void *addr);
+bool vma_overlaps(const struct vma_table *vt, const void *start,
+                  const void *end);
+void vma_fill_page(const struct vma *vma, struct page_table_entry *pte);
+
+#endif /* vm/vma.h */